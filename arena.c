@@ -0,0 +1,148 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16 // Enough for any type stored in a matrix or image
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    size_t size; // Payload bytes
+    size_t used; // Payload bytes handed out
+    uint8_t* data;
+};
+
+// Carve `size` aligned bytes from a block, or NULL if they do not fit
+static void* block_take(ArenaBlock* block, size_t size) {
+    uintptr_t start = (uintptr_t)(block->data + block->used);
+    size_t pad = (ARENA_ALIGN - start % ARENA_ALIGN) % ARENA_ALIGN;
+    if (pad + size > block->size - block->used) return NULL;
+    
+    void* ptr = block->data + block->used + pad;
+    block->used += pad + size;
+    return ptr;
+}
+
+// A block with room for `size` bytes: a spare one if any fits, else a new
+// one of at least the regular size
+static ArenaBlock* arena_new_block(Arena* arena, size_t size) {
+    size_t need = size + ARENA_ALIGN;
+    
+    for (ArenaBlock** link = &arena->spare; *link; link = &(*link)->next) {
+        if ((*link)->size >= need) {
+            ArenaBlock* block = *link;
+            *link = block->next;
+            block->used = 0;
+            return block;
+        }
+    }
+    
+    size_t payload = need > arena->block_size ? need : arena->block_size;
+    ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + payload);
+    if (!block) return NULL;
+    
+    block->size = payload;
+    block->used = 0;
+    block->data = (uint8_t*)(block + 1);
+    return block;
+}
+
+Arena* arena_create(size_t block_size) {
+    Arena* arena = (Arena*)calloc(1, sizeof(Arena));
+    if (!arena) return NULL;
+    
+    arena->block_size = block_size > 0 ? block_size : ARENA_DEFAULT_BLOCK;
+    return arena;
+}
+
+static void free_blocks(ArenaBlock* block) {
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+void arena_destroy(Arena* arena) {
+    if (arena) {
+        free_blocks(arena->blocks);
+        free_blocks(arena->spare);
+        free(arena);
+    }
+}
+
+void arena_reset(Arena* arena) {
+    if (!arena) return;
+    
+    // Everything handed out becomes invalid; the blocks are kept for reuse
+    while (arena->blocks) {
+        ArenaBlock* block = arena->blocks;
+        arena->blocks = block->next;
+        block->next = arena->spare;
+        arena->spare = block;
+    }
+    arena->last = NULL;
+    arena->last_block = NULL;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    if (size == 0) size = 1;
+    
+    ArenaBlock* block = arena->blocks;
+    void* ptr = block ? block_take(block, size) : NULL;
+    
+    if (!ptr) {
+        block = arena_new_block(arena, size);
+        if (!block) return NULL;
+        ptr = block_take(block, size);
+        
+        // An oversized block is full straight away, so it goes behind the
+        // block still being filled rather than replacing it
+        if (arena->blocks && size > arena->block_size / 2) {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+    }
+    
+    arena->last = ptr;
+    arena->last_block = block;
+    return ptr;
+}
+
+void* arena_calloc(Arena* arena, size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    
+    void* ptr = arena_alloc(arena, count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+// Grow an allocation. The most recent one grows in place when its block has
+// room; anything else is copied and the old bytes stay unused until reset.
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return arena_alloc(arena, new_size);
+    if (new_size <= old_size) return ptr;
+    
+    ArenaBlock* block = arena->last_block;
+    if (ptr == arena->last && block) {
+        size_t offset = (size_t)((uint8_t*)ptr - block->data);
+        if (new_size <= block->size - offset) {
+            block->used = offset + new_size;
+            return ptr;
+        }
+    }
+    
+    void* fresh = arena_alloc(arena, new_size);
+    if (fresh) memcpy(fresh, ptr, old_size);
+    return fresh;
+}
+
+size_t arena_bytes_used(Arena* arena) {
+    size_t used = 0;
+    for (ArenaBlock* block = arena ? arena->blocks : NULL; block; block = block->next) {
+        used += block->used;
+    }
+    return used;
+}
@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Region allocator for one compression job. Allocations are bumped out of
+// large blocks and are never freed one at a time; arena_reset() releases
+// everything at once and keeps the blocks for the next job, so repeated
+// jobs reuse the same memory instead of fragmenting the heap.
+// An arena is not thread-safe.
+#define ARENA_DEFAULT_BLOCK (1 << 20)
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks;     // Blocks in use, the one being filled first
+    ArenaBlock* spare;      // Blocks released by arena_reset(), kept for reuse
+    size_t block_size;      // Payload bytes of a regular block
+    void* last;             // Most recent allocation, which can grow in place
+    ArenaBlock* last_block; // Block holding `last`
+} Arena;
+
+// Function declarations
+Arena* arena_create(size_t block_size);
+void arena_destroy(Arena* arena);
+void arena_reset(Arena* arena);
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_calloc(Arena* arena, size_t count, size_t size);
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+size_t arena_bytes_used(Arena* arena);
+
+#endif // ARENA_H
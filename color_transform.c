@@ -0,0 +1,95 @@
+#include "color_transform.h"
+
+static inline uint8_t clamp_u8(int v) {
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+// YCoCg-R lifting in full precision:
+//   Co = R - B, t = B + (Co >> 1), Cg = G - t, Y = t + (Cg >> 1)
+static inline void forward_pixel(const uint8_t* px, int* y, int* co, int* cg) {
+    int o = px[0] - px[2];
+    int t = px[2] + (o >> 1);
+    int g = px[1] - t;
+    *y = t + (g >> 1);
+    *co = o;
+    *cg = g;
+}
+
+// Chroma value i of a part row set, as its positive and negative bytes
+static inline void split(int c, uint8_t* positive, uint8_t* negative, int i) {
+    positive[i] = (uint8_t)(c > 0 ? c : 0);
+    negative[i] = (uint8_t)(c < 0 ? -c : 0);
+}
+
+void color_transform_forward_luma(const uint8_t* pixels, int cols, int channels, uint8_t* y) {
+    const uint8_t* px = pixels;
+    
+    for (int x = 0; x < cols; x++, px += channels) {
+        int luma, co, cg;
+        forward_pixel(px, &luma, &co, &cg);
+        y[x] = (uint8_t)luma;
+    }
+}
+
+void color_transform_forward_chroma(const uint8_t* pixels, const uint8_t* below, int cols, int channels,
+                                    int subsample, uint8_t* parts) {
+    int chroma_cols = subsample ? (cols + 1) / 2 : cols;
+    uint8_t* co_pos = parts;
+    uint8_t* co_neg = parts + chroma_cols;
+    uint8_t* cg_pos = parts + 2 * chroma_cols;
+    uint8_t* cg_neg = parts + 3 * chroma_cols;
+    int luma, co, cg;
+    
+    if (!subsample) {
+        const uint8_t* px = pixels;
+        for (int x = 0; x < cols; x++, px += channels) {
+            forward_pixel(px, &luma, &co, &cg);
+            split(co, co_pos, co_neg, x);
+            split(cg, cg_pos, cg_neg, x);
+        }
+        return;
+    }
+    
+    if (!below) below = pixels;
+    for (int hx = 0; hx < chroma_cols; hx++) {
+        int x0 = 2 * hx;
+        int x1 = x0 + 1 < cols ? x0 + 1 : x0;
+        const uint8_t* block[4] = {
+            pixels + x0 * channels, pixels + x1 * channels, below + x0 * channels, below + x1 * channels
+        };
+        
+        // Average the signed values, rounding half away from zero
+        int co_sum = 0;
+        int cg_sum = 0;
+        for (int i = 0; i < 4; i++) {
+            forward_pixel(block[i], &luma, &co, &cg);
+            co_sum += co;
+            cg_sum += cg;
+        }
+        split(co_sum >= 0 ? (co_sum + 2) / 4 : -((2 - co_sum) / 4), co_pos, co_neg, hx);
+        split(cg_sum >= 0 ? (cg_sum + 2) / 4 : -((2 - cg_sum) / 4), cg_pos, cg_neg, hx);
+    }
+}
+
+// The lifting steps undone in reverse order. A subsampled chroma value is
+// replicated over the two pixels of its block in this row.
+void color_transform_inverse(const uint8_t* y, const uint8_t* parts, int cols, int channels, int subsample,
+                             uint8_t* pixels) {
+    int chroma_cols = subsample ? (cols + 1) / 2 : cols;
+    const uint8_t* co_pos = parts;
+    const uint8_t* co_neg = parts + chroma_cols;
+    const uint8_t* cg_pos = parts + 2 * chroma_cols;
+    const uint8_t* cg_neg = parts + 3 * chroma_cols;
+    uint8_t* px = pixels;
+    
+    for (int x = 0; x < cols; x++, px += channels) {
+        int c = subsample ? x / 2 : x;
+        int co = co_pos[c] - co_neg[c];
+        int cg = cg_pos[c] - cg_neg[c];
+        int t = y[x] - (cg >> 1);
+        int b = t - (co >> 1);
+        px[0] = clamp_u8(b + co);
+        px[1] = clamp_u8(cg + t);
+        px[2] = clamp_u8(b);
+    }
+}
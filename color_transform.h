@@ -0,0 +1,34 @@
+#ifndef COLOR_TRANSFORM_H
+#define COLOR_TRANSFORM_H
+
+#include <stdint.h>
+
+// Reversible YCoCg-R color transform for interleaved RGB(A) pixels, one
+// row at a time so no plane-sized buffer is needed.
+//
+// Y stays within 0..255, but the chroma differences Co and Cg need 9 bits
+// (-255..255). For sparse storage each chroma channel is split into two
+// byte rows holding its positive and negative parts: at most one of them
+// is non-zero per pixel, and a threshold on either is a threshold on the
+// true magnitude. Chroma rows are COLOR_TRANSFORM_CHROMA_PLANES byte rows
+// of chroma_cols values each, in the order Co+, Co-, Cg+, Cg-.
+//
+// With subsample set, chroma is 4:2:0: each 2x2 block of pixels is
+// averaged into one value, so chroma_cols is (cols + 1) / 2 and one chroma
+// row covers two pixel rows. Lossy. Otherwise chroma_cols is cols.
+//
+// Only channels 0..2 of the pixels are read or written; any further
+// channels (alpha) are untouched.
+#define COLOR_TRANSFORM_CHROMA_PLANES 4
+
+void color_transform_forward_luma(const uint8_t* pixels, int cols, int channels, uint8_t* y);
+// `below` is the pixel row under `pixels` when subsampling, or NULL when
+// there is none (the last row of an odd-height image)
+void color_transform_forward_chroma(const uint8_t* pixels, const uint8_t* below, int cols, int channels,
+                                    int subsample, uint8_t* parts);
+// Exact for unmodified rows; pixels are clamped to 0..255 when chroma was
+// thresholded or subsampled
+void color_transform_inverse(const uint8_t* y, const uint8_t* parts, int cols, int channels, int subsample,
+                             uint8_t* pixels);
+
+#endif // COLOR_TRANSFORM_H
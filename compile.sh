@@ -65,20 +65,53 @@ echo ""
 
 # Compile each source file
 echo "  - main.c"
-$CC -Wall -Wextra -std=c11 $CFLAGS -c main.c -o main.o
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c main.c -o main.o
 
 echo "  - gui.c"
-$CC -Wall -Wextra -std=c11 $CFLAGS -c gui.c -o gui.o
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c gui.c -o gui.o
 
 echo "  - image_processor.c"
-$CC -Wall -Wextra -std=c11 $CFLAGS -c image_processor.c -o image_processor.o
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c image_processor.c -o image_processor.o
 
 echo "  - sparse_matrix.c"
-$CC -Wall -Wextra -std=c11 $CFLAGS -c sparse_matrix.c -o sparse_matrix.o
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c sparse_matrix.c -o sparse_matrix.o
+
+echo "  - sparse_kernels.c"
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c sparse_kernels.c -o sparse_kernels.o
+
+echo "  - histogram.c"
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c histogram.c -o histogram.o
+
+echo "  - sparse_ops.c"
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c sparse_ops.c -o sparse_ops.o
+
+echo "  - sparse_transform.c"
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c sparse_transform.c -o sparse_transform.o
+
+echo "  - parallel.c"
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c parallel.c -o parallel.o
+
+echo "  - arena.c"
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c arena.c -o arena.o
+
+echo "  - tiled_matrix.c"
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c tiled_matrix.c -o tiled_matrix.o
+
+echo "  - joint_matrix.c"
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c joint_matrix.c -o joint_matrix.o
+
+echo "  - color_transform.c"
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c color_transform.c -o color_transform.o
+
+echo "  - sparse_io.c"
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c sparse_io.c -o sparse_io.o
+
+echo "  - entropy_coder.c"
+$CC -Wall -Wextra -std=c11 -pthread $CFLAGS -c entropy_coder.c -o entropy_coder.o
 
 echo ""
 echo "Linking executable..."
-$CC main.o gui.o image_processor.o sparse_matrix.o $LDFLAGS -lm -o image_compressor
+$CC main.o gui.o image_processor.o sparse_matrix.o sparse_kernels.o histogram.o sparse_ops.o sparse_transform.o parallel.o arena.o tiled_matrix.o joint_matrix.o color_transform.o sparse_io.o entropy_coder.o $LDFLAGS -lm -pthread -o image_compressor
 
 echo ""
 echo "✓ Compilation successful!"
@@ -0,0 +1,242 @@
+#include "entropy_coder.h"
+#include <string.h>
+
+#define HUFFMAN_SYMBOLS 256
+#define HUFFMAN_TABLE_SIZE (1 << HUFFMAN_MAX_BITS)
+#define HUFFMAN_HEADER_SIZE (1 + HUFFMAN_SYMBOLS / 2)
+
+#define MODE_RAW 0
+#define MODE_HUFFMAN 1
+
+size_t huffman_max_encoded_size(size_t n) {
+    // Coding is only used when it beats the raw fallback
+    return 1 + n;
+}
+
+// Code lengths from symbol frequencies by repeatedly merging the two
+// lightest nodes. With 256 symbols a linear search for the minimum is fine.
+static int build_lengths_once(const uint64_t* freq, uint8_t* lengths) {
+    uint64_t weight[2 * HUFFMAN_SYMBOLS];
+    int parent[2 * HUFFMAN_SYMBOLS];
+    int alive[2 * HUFFMAN_SYMBOLS];
+    int nodes = 0;
+    int leaves[HUFFMAN_SYMBOLS];
+    
+    memset(lengths, 0, HUFFMAN_SYMBOLS);
+    for (int s = 0; s < HUFFMAN_SYMBOLS; s++) {
+        if (freq[s]) {
+            leaves[s] = nodes;
+            weight[nodes] = freq[s];
+            parent[nodes] = -1;
+            alive[nodes] = 1;
+            nodes++;
+        } else {
+            leaves[s] = -1;
+        }
+    }
+    
+    if (nodes == 1) {
+        // A lone symbol still needs a one-bit code
+        for (int s = 0; s < HUFFMAN_SYMBOLS; s++) {
+            if (leaves[s] >= 0) lengths[s] = 1;
+        }
+        return 1;
+    }
+    
+    int remaining = nodes;
+    while (remaining > 1) {
+        int a = -1, b = -1;
+        for (int i = 0; i < nodes; i++) {
+            if (!alive[i]) continue;
+            if (a < 0 || weight[i] < weight[a]) {
+                b = a;
+                a = i;
+            } else if (b < 0 || weight[i] < weight[b]) {
+                b = i;
+            }
+        }
+        weight[nodes] = weight[a] + weight[b];
+        parent[nodes] = -1;
+        alive[nodes] = 1;
+        parent[a] = parent[b] = nodes;
+        alive[a] = alive[b] = 0;
+        nodes++;
+        remaining--;
+    }
+    
+    int max_len = 0;
+    for (int s = 0; s < HUFFMAN_SYMBOLS; s++) {
+        if (leaves[s] < 0) continue;
+        int len = 0;
+        for (int n = leaves[s]; parent[n] >= 0; n = parent[n]) len++;
+        lengths[s] = (uint8_t)(len < 255 ? len : 255);
+        if (len > max_len) max_len = len;
+    }
+    
+    return max_len;
+}
+
+// Limit code lengths by flattening the frequencies until the tree is
+// shallow enough; skewed streams lose a fraction of a bit per symbol at most
+static void build_lengths(const uint64_t* freq, uint8_t* lengths) {
+    uint64_t scaled[HUFFMAN_SYMBOLS];
+    memcpy(scaled, freq, sizeof(scaled));
+    
+    while (build_lengths_once(scaled, lengths) > HUFFMAN_MAX_BITS) {
+        for (int s = 0; s < HUFFMAN_SYMBOLS; s++) {
+            if (scaled[s]) scaled[s] = (scaled[s] >> 1) | 1;
+        }
+    }
+}
+
+// Canonical code assignment (as in DEFLATE), bit-reversed for an LSB-first
+// stream so the decoder can index its table with the low bits directly
+static void build_codes(const uint8_t* lengths, uint16_t* codes) {
+    int bl_count[HUFFMAN_MAX_BITS + 1] = { 0 };
+    int next_code[HUFFMAN_MAX_BITS + 2];
+    
+    for (int s = 0; s < HUFFMAN_SYMBOLS; s++) {
+        bl_count[lengths[s]]++;
+    }
+    bl_count[0] = 0;
+    
+    int code = 0;
+    for (int len = 1; len <= HUFFMAN_MAX_BITS; len++) {
+        code = (code + bl_count[len - 1]) << 1;
+        next_code[len] = code;
+    }
+    
+    for (int s = 0; s < HUFFMAN_SYMBOLS; s++) {
+        int len = lengths[s];
+        if (!len) continue;
+        int c = next_code[len]++;
+        int rev = 0;
+        for (int b = 0; b < len; b++) {
+            rev |= ((c >> b) & 1) << (len - 1 - b);
+        }
+        codes[s] = (uint16_t)rev;
+    }
+}
+
+static size_t store_raw(const uint8_t* in, size_t n, uint8_t* out) {
+    out[0] = MODE_RAW;
+    memcpy(out + 1, in, n);
+    return 1 + n;
+}
+
+size_t huffman_encode(const uint8_t* in, size_t n, uint8_t* out) {
+    if (n == 0) {
+        out[0] = MODE_RAW;
+        return 1;
+    }
+    
+    // Counts are as wide as n, so no symbol count can wrap
+    uint64_t freq[HUFFMAN_SYMBOLS] = { 0 };
+    for (size_t i = 0; i < n; i++) {
+        freq[in[i]]++;
+    }
+    
+    uint8_t lengths[HUFFMAN_SYMBOLS];
+    uint16_t codes[HUFFMAN_SYMBOLS];
+    build_lengths(freq, lengths);
+    build_codes(lengths, codes);
+    
+    // Fall back to raw storage when coding does not pay for its header
+    uint64_t bits = 0;
+    for (int s = 0; s < HUFFMAN_SYMBOLS; s++) {
+        bits += freq[s] * lengths[s];
+    }
+    if (HUFFMAN_HEADER_SIZE + (bits + 7) / 8 >= 1 + n) {
+        return store_raw(in, n, out);
+    }
+    
+    out[0] = MODE_HUFFMAN;
+    for (int s = 0; s < HUFFMAN_SYMBOLS; s += 2) {
+        out[1 + s / 2] = (uint8_t)(lengths[s] | (lengths[s + 1] << 4));
+    }
+    
+    uint8_t* dst = out + HUFFMAN_HEADER_SIZE;
+    uint64_t acc = 0;
+    int acc_bits = 0;
+    for (size_t i = 0; i < n; i++) {
+        acc |= (uint64_t)codes[in[i]] << acc_bits;
+        acc_bits += lengths[in[i]];
+        while (acc_bits >= 8) {
+            *dst++ = (uint8_t)acc;
+            acc >>= 8;
+            acc_bits -= 8;
+        }
+    }
+    if (acc_bits > 0) {
+        *dst++ = (uint8_t)acc;
+    }
+    
+    return (size_t)(dst - out);
+}
+
+int huffman_decode(const uint8_t* in, size_t in_len, uint8_t* out, size_t n) {
+    if (in_len < 1) return 0;
+    
+    if (in[0] == MODE_RAW) {
+        if (in_len != 1 + n) return 0;
+        memcpy(out, in + 1, n);
+        return 1;
+    }
+    if (in[0] != MODE_HUFFMAN || in_len < HUFFMAN_HEADER_SIZE) return 0;
+    
+    uint8_t lengths[HUFFMAN_SYMBOLS];
+    uint16_t codes[HUFFMAN_SYMBOLS];
+    for (int s = 0; s < HUFFMAN_SYMBOLS; s += 2) {
+        lengths[s] = in[1 + s / 2] & 0x0F;
+        lengths[s + 1] = in[1 + s / 2] >> 4;
+        if (lengths[s] > HUFFMAN_MAX_BITS || lengths[s + 1] > HUFFMAN_MAX_BITS) return 0;
+    }
+    
+    // Reject length sets that over-subscribe the code space (Kraft sum > 1)
+    uint32_t kraft = 0;
+    for (int s = 0; s < HUFFMAN_SYMBOLS; s++) {
+        if (lengths[s]) kraft += HUFFMAN_TABLE_SIZE >> lengths[s];
+    }
+    if (kraft > HUFFMAN_TABLE_SIZE) return 0;
+    
+    build_codes(lengths, codes);
+    
+    // Every table slot whose low bits match a code maps to that code's
+    // symbol and length; unused slots stay zero and flag corrupt input
+    uint16_t table[HUFFMAN_TABLE_SIZE];
+    memset(table, 0, sizeof(table));
+    for (int s = 0; s < HUFFMAN_SYMBOLS; s++) {
+        int len = lengths[s];
+        if (!len) continue;
+        for (int j = codes[s]; j < HUFFMAN_TABLE_SIZE; j += 1 << len) {
+            table[j] = (uint16_t)((s << 4) | len);
+        }
+    }
+    
+    const uint8_t* src = in + HUFFMAN_HEADER_SIZE;
+    const uint8_t* end = in + in_len;
+    uint64_t acc = 0;
+    int acc_bits = 0;
+    uint64_t bits_left = (uint64_t)(end - src) * 8;
+    
+    for (size_t i = 0; i < n; i++) {
+        // Top up to at least HUFFMAN_MAX_BITS bits; past the end the stream
+        // is padded with zeros and bits_left catches any overrun
+        if (acc_bits < HUFFMAN_MAX_BITS) {
+            while (acc_bits <= 56) {
+                acc |= (uint64_t)(src < end ? *src++ : 0) << acc_bits;
+                acc_bits += 8;
+            }
+        }
+        
+        uint16_t entry = table[acc & (HUFFMAN_TABLE_SIZE - 1)];
+        int len = entry & 0x0F;
+        if (!len || (uint64_t)len > bits_left) return 0;
+        out[i] = (uint8_t)(entry >> 4);
+        acc >>= len;
+        acc_bits -= len;
+        bits_left -= len;
+    }
+    
+    return 1;
+}
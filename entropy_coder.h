@@ -0,0 +1,27 @@
+#ifndef ENTROPY_CODER_H
+#define ENTROPY_CODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Canonical Huffman coding of byte streams.
+//
+// An encoded block starts with a mode byte. Mode 0 stores the bytes
+// verbatim (used when coding would not help). Mode 1 is followed by 128
+// bytes of 4-bit code lengths (two symbols per byte, low nibble first) and
+// an LSB-first bitstream. Codes are at most HUFFMAN_MAX_BITS long so the
+// decoder resolves every symbol with a single table lookup.
+#define HUFFMAN_MAX_BITS 12
+
+// Worst-case size of an encoded block for n input bytes
+size_t huffman_max_encoded_size(size_t n);
+
+// Encode n bytes into out (at least huffman_max_encoded_size(n) bytes).
+// Returns the encoded size.
+size_t huffman_encode(const uint8_t* in, size_t n, uint8_t* out);
+
+// Decode exactly n bytes from an encoded block of in_len bytes.
+// Returns 1 on success, 0 if the block is malformed.
+int huffman_decode(const uint8_t* in, size_t in_len, uint8_t* out, size_t n);
+
+#endif // ENTROPY_CODER_H
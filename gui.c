@@ -102,8 +102,9 @@ void on_file_selected(GtkFileChooserButton* button, gpointer data) {
                                           app_data->current_image->height, 3);
                 if (display_img) {
                     needs_conversion = 1;
-                    for (int i = 0; i < app_data->current_image->width * 
-                                     app_data->current_image->height; i++) {
+                    size_t pixels = (size_t)app_data->current_image->width *
+                                    app_data->current_image->height;
+                    for (size_t i = 0; i < pixels; i++) {
                         uint8_t gray = app_data->current_image->data[i];
                         display_img->data[i * 3 + 0] = gray;
                         display_img->data[i * 3 + 1] = gray;
@@ -163,7 +164,7 @@ void on_compress_clicked(GtkWidget* widget, gpointer data) {
     }
     
     // Get original file size for comparison
-    long original_size = 0;
+    int64_t original_size = 0;
     if (app_data->current_image) {
         // Save original temporarily to get file size
         const char* temp_orig = "temp_orig_size.jpg";
@@ -184,7 +185,7 @@ void on_compress_clicked(GtkWidget* widget, gpointer data) {
     }
     
     // Get compressed file size
-    long compressed_size = get_file_size(output_file);
+    int64_t compressed_size = get_file_size(output_file);
     
     // Free previous compressed image data
     if (app_data->compressed_image_data) {
@@ -196,7 +197,7 @@ void on_compress_clicked(GtkWidget* widget, gpointer data) {
         compressed_img->width, compressed_img->height, compressed_img->channels);
     if (app_data->compressed_image_data) {
         memcpy(app_data->compressed_image_data->data, compressed_img->data,
-               compressed_img->width * compressed_img->height * compressed_img->channels);
+               (size_t)compressed_img->width * compressed_img->height * compressed_img->channels);
         
         char status[512];
         if (original_size > 0 && compressed_size > 0) {
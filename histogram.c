@@ -0,0 +1,170 @@
+#include "histogram.h"
+#include "sparse_matrix.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SINGLE_BANKS 4            // Sub-histograms for single-channel rows
+#define BANK_FLUSH_PIXELS (1u << 30)
+
+// Rows [begin, end) of the image, counted into the band's own bins
+typedef struct {
+    const uint8_t* pixels;
+    int cols;
+    int channels;
+    int begin;
+    int end;
+    int64_t* bins; // channels * 256 counts
+    int failed;
+} HistogramBand;
+
+static void band_histogram(void* arg) {
+    HistogramBand* band = (HistogramBand*)arg;
+    int channels = band->channels;
+    size_t row_bytes = (size_t)band->cols * channels;
+    
+    if (channels == 1) {
+        // Consecutive equal bytes would otherwise increment the same counter
+        // back to back; spreading them over several banks keeps the
+        // increments independent
+        uint32_t* banks = (uint32_t*)calloc(SINGLE_BANKS * 256, sizeof(uint32_t));
+        if (!banks) {
+            band->failed = 1;
+            return;
+        }
+        size_t pending = 0;
+        for (int y = band->begin; y < band->end; y++) {
+            const uint8_t* row = band->pixels + (size_t)y * row_bytes;
+            size_t x = 0;
+            for (; x + SINGLE_BANKS <= row_bytes; x += SINGLE_BANKS) {
+                banks[row[x]]++;
+                banks[256 + row[x + 1]]++;
+                banks[512 + row[x + 2]]++;
+                banks[768 + row[x + 3]]++;
+            }
+            for (; x < row_bytes; x++) {
+                banks[row[x]]++;
+            }
+            // Flush before any 32-bit bank could overflow
+            pending += row_bytes;
+            if (pending >= BANK_FLUSH_PIXELS || y == band->end - 1) {
+                for (int v = 0; v < 256; v++) {
+                    band->bins[v] += (int64_t)banks[v] + banks[256 + v] + banks[512 + v] + banks[768 + v];
+                }
+                memset(banks, 0, SINGLE_BANKS * 256 * sizeof(uint32_t));
+                pending = 0;
+            }
+        }
+        free(banks);
+        return;
+    }
+    
+    // Interleaved channels already land in different tables
+    for (int y = band->begin; y < band->end; y++) {
+        const uint8_t* src = band->pixels + (size_t)y * row_bytes;
+        for (int x = 0; x < band->cols; x++, src += channels) {
+            for (int ch = 0; ch < channels; ch++) {
+                band->bins[ch * 256 + src[ch]]++;
+            }
+        }
+    }
+}
+
+// Count every channel of an interleaved image (channel c of pixel i at
+// pixels[i * channels + c]) in one pass over row bands on worker threads.
+// Fills out[0..channels); returns 1 on success, 0 on allocation failure.
+int histogram_from_interleaved(const uint8_t* pixels, int rows, int cols, int channels, ChannelHistogram* out) {
+    if (!pixels || !out || rows < 0 || cols < 0 || channels <= 0) return 0;
+    
+    int n = parallel_band_count((int64_t)rows * cols * channels, rows);
+    
+    HistogramBand* bands = (HistogramBand*)calloc((size_t)n, sizeof(HistogramBand));
+    int64_t* bins = (int64_t*)calloc((size_t)n * channels * 256, sizeof(int64_t));
+    if (!bands || !bins) {
+        free(bands);
+        free(bins);
+        return 0;
+    }
+    
+    for (int b = 0; b < n; b++) {
+        bands[b].pixels = pixels;
+        bands[b].cols = cols;
+        bands[b].channels = channels;
+        bands[b].begin = (int)((int64_t)rows * b / n);
+        bands[b].end = (int)((int64_t)rows * (b + 1) / n);
+        bands[b].bins = bins + (size_t)b * channels * 256;
+    }
+    parallel_run(band_histogram, bands, n, sizeof(HistogramBand));
+    
+    int ok = 1;
+    for (int b = 0; b < n; b++) {
+        ok &= !bands[b].failed;
+    }
+    
+    for (int ch = 0; ok && ch < channels; ch++) {
+        ChannelHistogram* hist = &out[ch];
+        memset(hist, 0, sizeof(*hist));
+        hist->rows = rows;
+        hist->cols = cols;
+        for (int b = 0; b < n; b++) {
+            const int64_t* src = bands[b].bins + (size_t)ch * 256;
+            for (int v = 0; v < 256; v++) {
+                hist->counts[v] += src[v];
+            }
+        }
+        
+        // Suffix sums: the survivors of threshold t are the values t+1..255
+        int64_t above = 0;
+        for (int t = 255; t >= 0; t--) {
+            hist->above[t] = above;
+            above += hist->counts[t];
+        }
+    }
+    
+    free(bands);
+    free(bins);
+    return ok;
+}
+
+// Non-zeros a conversion at this threshold would keep
+int64_t histogram_nnz(const ChannelHistogram* hist, uint8_t threshold) {
+    return hist->above[threshold];
+}
+
+// Estimated footprint of the channel converted at this threshold. A
+// histogram has no notion of runs, so every survivor is taken to be its
+// own run: the estimate never favours RLE and is an upper bound on what
+// SPARSE_FORMAT_AUTO actually produces.
+size_t histogram_size_bytes(const ChannelHistogram* hist, uint8_t threshold) {
+    int64_t nnz = hist->above[threshold];
+    return sparse_matrix_estimate_size_bytes(hist->rows, hist->cols, nnz, nnz);
+}
+
+float histogram_compression_ratio(const ChannelHistogram* hist, uint8_t threshold) {
+    size_t dense_size = dense_matrix_get_size_bytes(hist->rows, hist->cols);
+    size_t sparse_size = histogram_size_bytes(hist, threshold);
+    
+    if (sparse_size == 0) return 0.0f;
+    return (float)dense_size / (float)sparse_size;
+}
+
+// Fill nnz[t] and ratio[t] for all 256 thresholds; either may be NULL
+void histogram_curves(const ChannelHistogram* hist, int64_t* nnz, float* ratio) {
+    for (int t = 0; t < 256; t++) {
+        if (nnz) nnz[t] = histogram_nnz(hist, (uint8_t)t);
+        if (ratio) ratio[t] = histogram_compression_ratio(hist, (uint8_t)t);
+    }
+}
+
+// Lowest threshold at which all channels together are estimated to fit in
+// budget bytes (so the least detail is dropped), or -1 if none does
+int histogram_threshold_for_budget(const ChannelHistogram* hists, int channels, size_t budget) {
+    for (int t = 0; t < 256; t++) {
+        size_t total = sizeof(SparseMatrix*) * channels;
+        for (int ch = 0; ch < channels; ch++) {
+            total += histogram_size_bytes(&hists[ch], (uint8_t)t);
+        }
+        if (total <= budget) return t;
+    }
+    return -1;
+}
@@ -0,0 +1,25 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Value histogram of one image channel. Every threshold query is answered
+// from it in O(1), so a threshold can be chosen for a size budget without
+// any trial conversions.
+typedef struct {
+    int64_t counts[256]; // Pixels holding each value
+    int64_t above[256];  // above[t]: pixels strictly greater than t, i.e. nnz at threshold t
+    int rows;            // Channel rows
+    int cols;            // Channel cols
+} ChannelHistogram;
+
+// Function declarations
+int histogram_from_interleaved(const uint8_t* pixels, int rows, int cols, int channels, ChannelHistogram* out);
+int64_t histogram_nnz(const ChannelHistogram* hist, uint8_t threshold);
+size_t histogram_size_bytes(const ChannelHistogram* hist, uint8_t threshold);
+float histogram_compression_ratio(const ChannelHistogram* hist, uint8_t threshold);
+void histogram_curves(const ChannelHistogram* hist, int64_t* nnz, float* ratio);
+int histogram_threshold_for_budget(const ChannelHistogram* hists, int channels, size_t budget);
+
+#endif // HISTOGRAM_H
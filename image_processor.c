@@ -1,4 +1,5 @@
 #include "image_processor.h"
+#include "color_transform.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -21,6 +22,7 @@ Image* image_load(const char* filename) {
     Image* img = (Image*)malloc(sizeof(Image));
     if (!img) return NULL;
     
+    img->arena = NULL;
     img->data = stbi_load(filename, &img->width, &img->height, &img->channels, 0);
     if (!img->data) {
         free(img);
@@ -31,6 +33,10 @@ Image* image_load(const char* filename) {
 }
 
 void image_free(Image* img) {
+    if (img && img->arena) {
+        // Released with the rest of the arena
+        return;
+    }
     if (img) {
         if (img->data) {
             stbi_image_free(img->data);
@@ -40,16 +46,23 @@ void image_free(Image* img) {
 }
 
 Image* image_create(int width, int height, int channels) {
-    Image* img = (Image*)malloc(sizeof(Image));
+    return image_create_arena(width, height, channels, NULL);
+}
+
+// With an arena, the struct and pixels come from it and image_free() is a no-op
+Image* image_create_arena(int width, int height, int channels, Arena* arena) {
+    size_t bytes = (size_t)width * height * channels * sizeof(uint8_t);
+    Image* img = (Image*)(arena ? arena_alloc(arena, sizeof(Image)) : malloc(sizeof(Image)));
     if (!img) return NULL;
     
     img->width = width;
     img->height = height;
     img->channels = channels;
-    img->data = (uint8_t*)malloc(width * height * channels * sizeof(uint8_t));
+    img->arena = arena;
+    img->data = (uint8_t*)(arena ? arena_alloc(arena, bytes) : malloc(bytes));
     
     if (!img->data) {
-        free(img);
+        if (!arena) free(img);
         return NULL;
     }
     
@@ -57,70 +70,213 @@ Image* image_create(int width, int height, int channels) {
 }
 
 SparseMatrix** image_to_sparse_matrices(Image* img, uint8_t threshold) {
+    return image_to_sparse_matrices_arena(img, threshold, NULL);
+}
+
+// With an arena, the channel array and every matrix come from it and need
+// no freeing; the arena is released as a whole instead
+SparseMatrix** image_to_sparse_matrices_arena(Image* img, uint8_t threshold, Arena* arena) {
     if (!img || !img->data) return NULL;
     
-    SparseMatrix** sparse_channels = (SparseMatrix**)malloc(sizeof(SparseMatrix*) * img->channels);
+    size_t bytes = sizeof(SparseMatrix*) * img->channels;
+    SparseMatrix** sparse_channels = (SparseMatrix**)(arena ? arena_alloc(arena, bytes) : malloc(bytes));
     if (!sparse_channels) return NULL;
     
-    for (int ch = 0; ch < img->channels; ch++) {
-        uint8_t* channel_data = (uint8_t*)malloc(img->width * img->height * sizeof(uint8_t));
-        if (!channel_data) {
-            // Cleanup on error
-            for (int i = 0; i < ch; i++) {
-                sparse_matrix_free(sparse_channels[i]);
-            }
-            free(sparse_channels);
-            return NULL;
-        }
-        
-        // Extract channel data
-        for (int i = 0; i < img->width * img->height; i++) {
-            channel_data[i] = img->data[i * img->channels + ch];
-        }
-        
-        // Convert to sparse matrix
-        sparse_channels[ch] = sparse_matrix_from_dense(channel_data, img->height, img->width, threshold);
-        free(channel_data);
-        
-        if (!sparse_channels[ch]) {
-            // Cleanup on error
-            for (int i = 0; i < ch; i++) {
-                sparse_matrix_free(sparse_channels[i]);
-            }
-            free(sparse_channels);
-            return NULL;
-        }
+    // One fused walk over the interleaved pixels fills every channel, each
+    // in whichever sparse layout suits its density
+    if (!sparse_matrices_from_interleaved_arena(img->data, img->height, img->width, img->channels,
+                                                threshold, SPARSE_FORMAT_AUTO, sparse_channels, arena)) {
+        if (!arena) free(sparse_channels);
+        return NULL;
     }
     
     return sparse_channels;
 }
 
 Image* sparse_matrices_to_image(SparseMatrix** sparse_channels, int channels) {
+    return sparse_matrices_to_image_arena(sparse_channels, channels, NULL);
+}
+
+Image* sparse_matrices_to_image_arena(SparseMatrix** sparse_channels, int channels, Arena* arena) {
     if (!sparse_channels || channels == 0) return NULL;
     
     int width = sparse_channels[0]->cols;
     int height = sparse_channels[0]->rows;
     
-    Image* img = image_create(width, height, channels);
+    Image* img = image_create_arena(width, height, channels, arena);
     if (!img) return NULL;
     
+    // Zero the image once, then write each channel's non-zeros straight
+    // into their interleaved slots
+    memset(img->data, 0, (size_t)width * height * channels);
     for (int ch = 0; ch < channels; ch++) {
-        uint8_t* channel_data = (uint8_t*)malloc(width * height * sizeof(uint8_t));
-        if (!channel_data) {
-            image_free(img);
+        sparse_matrix_scatter(sparse_channels[ch], img->data + ch, channels);
+    }
+    
+    return img;
+}
+
+// Row source for image_to_ycocg(): either Y followed by the channels past
+// the third, or the four chroma part rows
+typedef struct {
+    const Image* img;
+    int subsample;
+} YCoCgRows;
+
+static void ycocg_luma_rows(void* ctx, int y, uint8_t* planes) {
+    const YCoCgRows* src = (const YCoCgRows*)ctx;
+    int cols = src->img->width;
+    int channels = src->img->channels;
+    const uint8_t* px = src->img->data + (int64_t)y * cols * channels;
+    
+    color_transform_forward_luma(px, cols, channels, planes);
+    for (int ch = 3; ch < channels; ch++) {
+        uint8_t* dst = planes + (int64_t)(ch - 2) * cols;
+        for (int x = 0; x < cols; x++) {
+            dst[x] = px[x * channels + ch];
+        }
+    }
+}
+
+static void ycocg_chroma_rows(void* ctx, int y, uint8_t* planes) {
+    const YCoCgRows* src = (const YCoCgRows*)ctx;
+    const Image* img = src->img;
+    int64_t stride = (int64_t)img->width * img->channels;
+    int row = src->subsample ? 2 * y : y;
+    const uint8_t* below = src->subsample && row + 1 < img->height ? img->data + (row + 1) * stride : NULL;
+    
+    color_transform_forward_chroma(img->data + row * stride, below, img->width, img->channels,
+                                   src->subsample, planes);
+}
+
+// Convert with R, G, B replaced by Y, Co, Cg, so luminance lives in one
+// channel and the chroma channels are mostly near zero. With subsample
+// set, the chroma matrices are half width and height. Like
+// image_to_sparse_matrices(), every plane is built from a row-sized
+// buffer, here with the transform applied as each row is produced.
+YCoCgImage* image_to_ycocg(Image* img, uint8_t threshold, int subsample) {
+    if (!img || !img->data) return NULL;
+    
+    YCoCgImage* ycocg = (YCoCgImage*)calloc(1, sizeof(YCoCgImage));
+    if (!ycocg) return NULL;
+    ycocg->channel_count = img->channels;
+    
+    if (img->channels < 3) {
+        ycocg->channels = image_to_sparse_matrices(img, threshold);
+        if (!ycocg->channels) {
+            free(ycocg);
             return NULL;
         }
-        
-        sparse_matrix_to_dense(sparse_channels[ch], channel_data);
-        
-        // Copy channel data back to image
-        for (int i = 0; i < width * height; i++) {
-            img->data[i * channels + ch] = channel_data[i];
+        return ycocg;
+    }
+    
+    int rows = img->height;
+    int cols = img->width;
+    int chroma_rows = subsample ? (rows + 1) / 2 : rows;
+    int chroma_cols = subsample ? (cols + 1) / 2 : cols;
+    YCoCgRows src = { img, subsample };
+    SparseMatrix* chroma[COLOR_TRANSFORM_CHROMA_PLANES];
+    
+    ycocg->channels = (SparseMatrix**)calloc(img->channels, sizeof(SparseMatrix*));
+    
+    // Y and the channels past the third are built into slots 2 onward;
+    // Y then moves to slot 0 and Cg takes its place
+    int ok = ycocg->channels &&
+             sparse_matrices_from_rows(ycocg_luma_rows, &src, rows, cols, img->channels - 2, threshold,
+                                       SPARSE_FORMAT_AUTO, ycocg->channels + 2);
+    if (ok) {
+        ycocg->channels[0] = ycocg->channels[2];
+        ycocg->channels[2] = NULL;
+        ok = sparse_matrices_from_rows(ycocg_chroma_rows, &src, chroma_rows, chroma_cols,
+                                       COLOR_TRANSFORM_CHROMA_PLANES, threshold, SPARSE_FORMAT_AUTO, chroma);
+    }
+    if (ok) {
+        ycocg->channels[1] = chroma[0];
+        ycocg->chroma_negative[0] = chroma[1];
+        ycocg->channels[2] = chroma[2];
+        ycocg->chroma_negative[1] = chroma[3];
+    }
+    
+    if (!ok) {
+        ycocg_image_free(ycocg);
+        return NULL;
+    }
+    return ycocg;
+}
+
+// Inverse of image_to_ycocg(). Subsampled chroma is recognised by its
+// smaller size; each chroma row then serves two image rows. Rows are read
+// one at a time, so only row-sized buffers are needed besides the image.
+Image* ycocg_to_image(YCoCgImage* ycocg) {
+    if (!ycocg || !ycocg->channels) return NULL;
+    
+    int channels = ycocg->channel_count;
+    SparseMatrix** sparse_channels = ycocg->channels;
+    if (channels < 3) return sparse_matrices_to_image(sparse_channels, channels);
+    
+    int rows = sparse_channels[0]->rows;
+    int cols = sparse_channels[0]->cols;
+    int chroma_cols = sparse_channels[1]->cols;
+    int subsampled = sparse_channels[1]->rows != rows || chroma_cols != cols;
+    SparseMatrix* chroma[COLOR_TRANSFORM_CHROMA_PLANES] = {
+        sparse_channels[1], ycocg->chroma_negative[0], sparse_channels[2], ycocg->chroma_negative[1]
+    };
+    
+    Image* img = image_create(cols, rows, channels);
+    uint8_t* y = (uint8_t*)malloc((size_t)cols + (size_t)COLOR_TRANSFORM_CHROMA_PLANES * chroma_cols);
+    if (!img || !y) {
+        image_free(img);
+        free(y);
+        return NULL;
+    }
+    uint8_t* parts = y + cols;
+    
+    // Alpha is scattered into zeroed slots; color overwrites its own
+    if (channels > 3) memset(img->data, 0, (size_t)rows * cols * channels);
+    for (int row = 0; row < rows; row++) {
+        sparse_matrix_to_dense_region(sparse_channels[0], 0, row, cols, 1, y);
+        if (!subsampled || row % 2 == 0) {
+            for (int p = 0; p < COLOR_TRANSFORM_CHROMA_PLANES; p++) {
+                sparse_matrix_to_dense_region(chroma[p], 0, subsampled ? row / 2 : row, chroma_cols, 1,
+                                              parts + (int64_t)p * chroma_cols);
+            }
         }
-        
-        free(channel_data);
+        color_transform_inverse(y, parts, cols, channels, subsampled,
+                                img->data + (int64_t)row * cols * channels);
+    }
+    for (int ch = 3; ch < channels; ch++) {
+        sparse_matrix_scatter(sparse_channels[ch], img->data + ch, channels);
+    }
+    
+    free(y);
+    return img;
+}
+
+void ycocg_image_free(YCoCgImage* ycocg) {
+    if (!ycocg) return;
+    
+    for (int ch = 0; ycocg->channels && ch < ycocg->channel_count; ch++) {
+        sparse_matrix_free(ycocg->channels[ch]);
     }
+    free(ycocg->channels);
+    sparse_matrix_free(ycocg->chroma_negative[0]);
+    sparse_matrix_free(ycocg->chroma_negative[1]);
+    free(ycocg);
+}
+
+// All channels in one shared coordinate list; see joint_matrix.h
+JointMatrix* image_to_joint_matrix(Image* img, uint8_t threshold) {
+    if (!img || !img->data) return NULL;
+    return joint_matrix_from_interleaved(img->data, img->height, img->width, img->channels, threshold);
+}
+
+Image* joint_matrix_to_image(JointMatrix* joint) {
+    if (!joint) return NULL;
+    
+    Image* img = image_create(joint->cols, joint->rows, joint->channels);
+    if (!img) return NULL;
     
+    joint_matrix_to_interleaved(joint, img->data);
     return img;
 }
 
@@ -150,10 +306,10 @@ int image_save_with_quality(Image* img, const char* filename, int quality) {
     return 0;
 }
 
-int get_file_size(const char* filename) {
+int64_t get_file_size(const char* filename) {
     struct stat st;
     if (stat(filename, &st) == 0) {
-        return (int)st.st_size;
+        return (int64_t)st.st_size;
     }
     return 0;
 }
@@ -169,7 +325,10 @@ Image* image_resize(Image* img, int new_width, int new_height) {
     float x_ratio = (float)img->width / (float)new_width;
     float y_ratio = (float)img->height / (float)new_height;
     
+    // Offsets are size_t so images past 2^31 bytes are addressed correctly
+    size_t channels = (size_t)img->channels;
     for (int y = 0; y < new_height; y++) {
+        uint8_t* out = resized->data + (size_t)y * new_width * channels;
         for (int x = 0; x < new_width; x++) {
             float src_x = (x + 0.5f) * x_ratio - 0.5f;
             float src_y = (y + 0.5f) * y_ratio - 0.5f;
@@ -182,17 +341,20 @@ Image* image_resize(Image* img, int new_width, int new_height) {
             float fx = src_x - x1;
             float fy = src_y - y1;
             
+            const uint8_t* row1 = img->data + (size_t)y1 * img->width * channels;
+            const uint8_t* row2 = img->data + (size_t)y2 * img->width * channels;
+            
             for (int c = 0; c < img->channels; c++) {
                 // Bilinear interpolation
-                float p1 = img->data[(y1 * img->width + x1) * img->channels + c];
-                float p2 = img->data[(y1 * img->width + x2) * img->channels + c];
-                float p3 = img->data[(y2 * img->width + x1) * img->channels + c];
-                float p4 = img->data[(y2 * img->width + x2) * img->channels + c];
+                float p1 = row1[x1 * channels + c];
+                float p2 = row1[x2 * channels + c];
+                float p3 = row2[x1 * channels + c];
+                float p4 = row2[x2 * channels + c];
                 
                 float p = (p1 * (1.0f - fx) + p2 * fx) * (1.0f - fy) +
                           (p3 * (1.0f - fx) + p4 * fx) * fy;
                 
-                resized->data[(y * new_width + x) * img->channels + c] = (uint8_t)(p + 0.5f);
+                out[x * channels + c] = (uint8_t)(p + 0.5f);
             }
         }
     }
@@ -206,7 +368,7 @@ Image* image_compress_50_percent(Image* img, const char* output_file, float* siz
     // Save original to temp file to get original size
     const char* temp_original = "temp_original_comp_check.jpg";
     image_save_with_quality(img, temp_original, 95);
-    long original_size = get_file_size(temp_original);
+    int64_t original_size = get_file_size(temp_original);
     
     // Strategy: Combine resizing (reduces dimensions by ~30%) and quality reduction
     // This typically achieves ~50% file size reduction
@@ -228,8 +390,8 @@ Image* image_compress_50_percent(Image* img, const char* output_file, float* siz
     
     // Try different quality levels to achieve ~50% reduction
     int quality = 75;
-    long target_size = original_size / 2;  // 50% of original
-    long best_size = 0;
+    int64_t target_size = original_size / 2;  // 50% of original
+    int64_t best_size = 0;
     Image* best_result = NULL;
     int best_quality = quality;
     
@@ -242,9 +404,9 @@ Image* image_compress_50_percent(Image* img, const char* output_file, float* siz
         snprintf(temp_file, sizeof(temp_file), "temp_comp_%d.jpg", attempt);
         
         image_save_with_quality(resized, temp_file, quality);
-        long current_size = get_file_size(temp_file);
+        int64_t current_size = get_file_size(temp_file);
         
-        if (current_size <= target_size || (best_result == NULL || labs(current_size - target_size) < labs(best_size - target_size))) {
+        if (current_size <= target_size || (best_result == NULL || llabs(current_size - target_size) < llabs(best_size - target_size))) {
             if (best_result) {
                 image_free(best_result);
             }
@@ -272,7 +434,7 @@ Image* image_compress_50_percent(Image* img, const char* output_file, float* siz
     
     // Save resized image with best quality found
     image_save_with_quality(resized, output_file, best_quality);
-    long final_size = get_file_size(output_file);
+    int64_t final_size = get_file_size(output_file);
     
     // If we haven't reached 50%, try adjusting quality one more time
     if (final_size > target_size && best_quality > 30) {
@@ -300,14 +462,14 @@ Image* image_compress_50_percent(Image* img, const char* output_file, float* siz
 float calculate_total_compression_ratio(SparseMatrix** sparse_channels, int channels, int width, int height) {
     if (!sparse_channels || channels == 0) return 0.0f;
     
-    int total_dense_size = dense_matrix_get_size_bytes(height, width) * channels;
-    int total_sparse_size = sizeof(SparseMatrix*) * channels;
+    size_t total_dense_size = dense_matrix_get_size_bytes(height, width) * channels;
+    size_t total_sparse_size = sizeof(SparseMatrix*) * channels;
     
     for (int i = 0; i < channels; i++) {
         total_sparse_size += sparse_matrix_get_size_bytes(sparse_channels[i]);
     }
     
     if (total_sparse_size == 0) return 0.0f;
-    return (float)total_dense_size / total_sparse_size;
+    return (float)total_dense_size / (float)total_sparse_size;
 }
 
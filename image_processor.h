@@ -2,6 +2,7 @@
 #define IMAGE_PROCESSOR_H
 
 #include "sparse_matrix.h"
+#include "joint_matrix.h"
 #include <stdint.h>
 
 // Forward declarations - implementation in .c file
@@ -12,20 +13,42 @@ typedef struct {
     int width;
     int height;
     int channels;
+    Arena* arena; // Owner of the struct and pixels, NULL when they are on the heap
 } Image;
 
+// Sparse channels of an image in YCoCg-R space (see color_transform.h).
+// channels holds one matrix per image channel, like
+// image_to_sparse_matrices(): Y, Co, Cg, then any further channels
+// (alpha) as-is. Co and Cg need 9 bits, so their matrices hold only the
+// positive parts and chroma_negative holds the magnitudes of the negative
+// ones. Images with fewer than three channels are stored directly and
+// have no negative parts.
+typedef struct {
+    SparseMatrix** channels;          // channel_count matrices
+    SparseMatrix* chroma_negative[2]; // Co-, Cg-, or NULL
+    int channel_count;
+} YCoCgImage;
+
 // Function declarations
 Image* image_load(const char* filename);
 void image_free(Image* img);
 SparseMatrix** image_to_sparse_matrices(Image* img, uint8_t threshold);
+SparseMatrix** image_to_sparse_matrices_arena(Image* img, uint8_t threshold, Arena* arena);
 Image* sparse_matrices_to_image(SparseMatrix** sparse_channels, int channels);
+Image* sparse_matrices_to_image_arena(SparseMatrix** sparse_channels, int channels, Arena* arena);
+YCoCgImage* image_to_ycocg(Image* img, uint8_t threshold, int subsample);
+Image* ycocg_to_image(YCoCgImage* ycocg);
+void ycocg_image_free(YCoCgImage* ycocg);
+JointMatrix* image_to_joint_matrix(Image* img, uint8_t threshold);
+Image* joint_matrix_to_image(JointMatrix* joint);
 int image_save(Image* img, const char* filename);
 int image_save_with_quality(Image* img, const char* filename, int quality);
 Image* image_create(int width, int height, int channels);
+Image* image_create_arena(int width, int height, int channels, Arena* arena);
 Image* image_resize(Image* img, int new_width, int new_height);
 Image* image_compress_50_percent(Image* img, const char* output_file, float* size_reduction);
 float calculate_total_compression_ratio(SparseMatrix** sparse_channels, int channels, int width, int height);
-int get_file_size(const char* filename);
+int64_t get_file_size(const char* filename);
 
 #endif // IMAGE_PROCESSOR_H
 
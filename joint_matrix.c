@@ -0,0 +1,230 @@
+#include "joint_matrix.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Rows [begin, end) of a conversion or reconstruction
+typedef struct {
+    JointMatrix* joint;
+    const uint8_t* src;  // Interleaved input (conversion)
+    uint8_t* dst;        // Interleaved output (reconstruction)
+    int begin;
+    int end;
+} JointBand;
+
+// Mask of the channels of one pixel that pass the threshold
+static inline unsigned pixel_mask(const uint8_t* px, int channels, uint8_t threshold) {
+    unsigned mask = 0;
+    for (int c = 0; c < channels; c++) {
+        mask |= (unsigned)(px[c] > threshold) << c;
+    }
+    return mask;
+}
+
+// Pass 1: stored pixels and values of each row, written one slot ahead so
+// a prefix sum turns them into row offsets
+static void band_count(void* arg) {
+    JointBand* band = (JointBand*)arg;
+    JointMatrix* joint = band->joint;
+    int channels = joint->channels;
+    size_t row_bytes = (size_t)joint->cols * channels;
+    
+    for (int y = band->begin; y < band->end; y++) {
+        const uint8_t* px = band->src + (size_t)y * row_bytes;
+        int64_t pixels = 0;
+        int64_t values = 0;
+        for (int x = 0; x < joint->cols; x++, px += channels) {
+            unsigned mask = pixel_mask(px, channels, joint->threshold);
+            pixels += mask != 0;
+            values += __builtin_popcount(mask);
+        }
+        joint->row_ptr[y + 1] = pixels;
+        joint->value_ptr[y + 1] = values;
+    }
+}
+
+// Pass 2: fill each row at the offsets found by pass 1
+static void band_fill(void* arg) {
+    JointBand* band = (JointBand*)arg;
+    JointMatrix* joint = band->joint;
+    int channels = joint->channels;
+    unsigned full = (1u << channels) - 1;
+    size_t row_bytes = (size_t)joint->cols * channels;
+    
+    for (int y = band->begin; y < band->end; y++) {
+        const uint8_t* px = band->src + (size_t)y * row_bytes;
+        int64_t k = joint->row_ptr[y];
+        int64_t v = joint->value_ptr[y];
+        for (int x = 0; x < joint->cols; x++, px += channels) {
+            unsigned mask = pixel_mask(px, channels, joint->threshold);
+            if (!mask) continue;
+            
+            joint->col_idx[k] = x;
+            joint->mask[k++] = (uint8_t)mask;
+            if (mask == full) {
+                memcpy(joint->values + v, px, channels);
+                v += channels;
+            } else {
+                for (int c = 0; c < channels; c++) {
+                    if (mask & (1u << c)) joint->values[v++] = px[c];
+                }
+            }
+        }
+    }
+}
+
+// Rows [begin, end) of the image back into interleaved pixels
+static void band_reconstruct(void* arg) {
+    JointBand* band = (JointBand*)arg;
+    JointMatrix* joint = band->joint;
+    int channels = joint->channels;
+    unsigned full = (1u << channels) - 1;
+    size_t row_bytes = (size_t)joint->cols * channels;
+    
+    for (int y = band->begin; y < band->end; y++) {
+        uint8_t* row = band->dst + (size_t)y * row_bytes;
+        memset(row, 0, row_bytes);
+        
+        int64_t v = joint->value_ptr[y];
+        for (int64_t k = joint->row_ptr[y]; k < joint->row_ptr[y + 1]; k++) {
+            // Each stored pixel is written whole, channel values side by side
+            uint8_t* px = row + (size_t)joint->col_idx[k] * channels;
+            unsigned mask = joint->mask[k];
+            if (mask == full) {
+                memcpy(px, joint->values + v, channels);
+                v += channels;
+            } else {
+                for (int c = 0; c < channels; c++) {
+                    if (mask & (1u << c)) px[c] = joint->values[v++];
+                }
+            }
+        }
+    }
+}
+
+// Split the rows into bands (see parallel_band_count()) and run fn over them
+static void joint_run(JointMatrix* joint, void (*fn)(void*), const uint8_t* src, uint8_t* dst) {
+    int n = parallel_band_count((int64_t)joint->rows * joint->cols * joint->channels, joint->rows);
+    
+    JointBand local;
+    JointBand* bands = n > 1 ? (JointBand*)calloc(n, sizeof(JointBand)) : NULL;
+    if (!bands) {
+        // One band needs no threads, and is the fallback if memory is short
+        n = 1;
+        bands = &local;
+    }
+    
+    for (int b = 0; b < n; b++) {
+        bands[b].joint = joint;
+        bands[b].src = src;
+        bands[b].dst = dst;
+        bands[b].begin = (int)((int64_t)joint->rows * b / n);
+        bands[b].end = (int)((int64_t)joint->rows * (b + 1) / n);
+    }
+    parallel_run(fn, bands, n, sizeof(JointBand));
+    
+    if (bands != &local) free(bands);
+}
+
+// Convert an interleaved image (channel c of pixel i at
+// pixels[i * channels + c]) in two passes over row bands: count each row,
+// prefix-sum the counts into offsets, then fill every row in place.
+JointMatrix* joint_matrix_from_interleaved(const uint8_t* pixels, int rows, int cols, int channels,
+                                           uint8_t threshold) {
+    if (!pixels || rows <= 0 || cols <= 0 || channels <= 0 || channels > JOINT_MATRIX_MAX_CHANNELS) {
+        return NULL;
+    }
+    
+    JointMatrix* joint = (JointMatrix*)calloc(1, sizeof(JointMatrix));
+    if (!joint) return NULL;
+    
+    joint->rows = rows;
+    joint->cols = cols;
+    joint->channels = channels;
+    joint->threshold = threshold;
+    joint->row_ptr = (int64_t*)calloc((size_t)rows + 1, sizeof(int64_t));
+    joint->value_ptr = (int64_t*)calloc((size_t)rows + 1, sizeof(int64_t));
+    if (!joint->row_ptr || !joint->value_ptr) {
+        joint_matrix_free(joint);
+        return NULL;
+    }
+    
+    joint_run(joint, band_count, pixels, NULL);
+    for (int y = 0; y < rows; y++) {
+        joint->row_ptr[y + 1] += joint->row_ptr[y];
+        joint->value_ptr[y + 1] += joint->value_ptr[y];
+    }
+    joint->pixels = joint->row_ptr[rows];
+    joint->size = joint->value_ptr[rows];
+    
+    joint->col_idx = (int*)malloc(sizeof(int) * (size_t)(joint->pixels > 0 ? joint->pixels : 1));
+    joint->mask = (uint8_t*)malloc((size_t)(joint->pixels > 0 ? joint->pixels : 1));
+    joint->values = (uint8_t*)malloc((size_t)(joint->size > 0 ? joint->size : 1));
+    if (!joint->col_idx || !joint->mask || !joint->values) {
+        joint_matrix_free(joint);
+        return NULL;
+    }
+    
+    joint_run(joint, band_fill, pixels, NULL);
+    return joint;
+}
+
+void joint_matrix_free(JointMatrix* joint) {
+    if (joint) {
+        free(joint->row_ptr);
+        free(joint->value_ptr);
+        free(joint->col_idx);
+        free(joint->mask);
+        free(joint->values);
+        free(joint);
+    }
+}
+
+// Write the whole image into rows * cols * channels interleaved bytes
+void joint_matrix_to_interleaved(JointMatrix* joint, uint8_t* pixels) {
+    joint_run(joint, band_reconstruct, NULL, pixels);
+}
+
+// Channel value at (row, col): binary search for the pixel in its row, then
+// popcounts over the masks before it locate the value
+uint8_t joint_matrix_get(JointMatrix* joint, int row, int col, int channel) {
+    if (row < 0 || row >= joint->rows || col < 0 || col >= joint->cols) return 0;
+    if (channel < 0 || channel >= joint->channels) return 0;
+    
+    int64_t lo = joint->row_ptr[row];
+    int64_t hi = joint->row_ptr[row + 1];
+    int64_t first = lo;
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (joint->col_idx[mid] < col) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == joint->row_ptr[row + 1] || joint->col_idx[lo] != col) return 0;
+    
+    unsigned mask = joint->mask[lo];
+    if (!(mask & (1u << channel))) return 0;
+    
+    int64_t v = joint->value_ptr[row];
+    for (int64_t k = first; k < lo; k++) {
+        v += __builtin_popcount(joint->mask[k]);
+    }
+    v += __builtin_popcount(mask & ((1u << channel) - 1));
+    return joint->values[v];
+}
+
+size_t joint_matrix_get_size_bytes(JointMatrix* joint) {
+    // Two row offset arrays, a column and mask per pixel, then the values
+    return sizeof(JointMatrix) + 2 * ((size_t)joint->rows + 1) * sizeof(int64_t) +
+           (size_t)joint->pixels * (sizeof(int) + sizeof(uint8_t)) + (size_t)joint->size * sizeof(uint8_t);
+}
+
+float joint_matrix_compression_ratio(JointMatrix* joint) {
+    size_t dense_size = (size_t)joint->rows * joint->cols * joint->channels * sizeof(uint8_t);
+    size_t joint_size = joint_matrix_get_size_bytes(joint);
+    
+    if (joint_size == 0) return 0.0f;
+    return (float)dense_size / (float)joint_size;
+}
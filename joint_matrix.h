@@ -0,0 +1,37 @@
+#ifndef JOINT_MATRIX_H
+#define JOINT_MATRIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JOINT_MATRIX_MAX_CHANNELS 8
+
+// Joint sparse image: all channels share one coordinate list. A pixel is
+// stored when any of its channels passes the threshold; a per-pixel mask
+// records which ones did, and only those channel values are kept. For
+// photos, where channels pass together, this stores one (row, col) per
+// pixel instead of one per channel value.
+typedef struct {
+    int64_t* row_ptr;    // rows + 1 offsets into col_idx/mask
+    int64_t* value_ptr;  // rows + 1 offsets into values
+    int* col_idx;        // Column of each stored pixel, ascending within a row
+    uint8_t* mask;       // Bit c set when channel c of the pixel passed the threshold
+    uint8_t* values;     // Surviving channel values, pixel by pixel in channel order
+    int64_t pixels;      // Number of stored pixels
+    int64_t size;        // Number of stored channel values
+    int rows;            // Image height
+    int cols;            // Image width
+    int channels;        // Channels per pixel, at most JOINT_MATRIX_MAX_CHANNELS
+    uint8_t threshold;   // Threshold below which values are considered zero
+} JointMatrix;
+
+// Function declarations
+JointMatrix* joint_matrix_from_interleaved(const uint8_t* pixels, int rows, int cols, int channels,
+                                           uint8_t threshold);
+void joint_matrix_free(JointMatrix* joint);
+void joint_matrix_to_interleaved(JointMatrix* joint, uint8_t* pixels);
+uint8_t joint_matrix_get(JointMatrix* joint, int row, int col, int channel);
+size_t joint_matrix_get_size_bytes(JointMatrix* joint);
+float joint_matrix_compression_ratio(JointMatrix* joint);
+
+#endif // JOINT_MATRIX_H
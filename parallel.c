@@ -0,0 +1,79 @@
+#include "parallel.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define PARALLEL_MAX_THREADS 256
+
+static int thread_override = 0;
+
+static int cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+int parallel_thread_count(void) {
+    int threads = thread_override > 0 ? thread_override : cpu_count();
+    return threads < PARALLEL_MAX_THREADS ? threads : PARALLEL_MAX_THREADS;
+}
+
+void parallel_set_thread_count(int threads) {
+    thread_override = threads > 0 ? threads : 0;
+}
+
+int parallel_band_count(int64_t pixels, int64_t chunks) {
+    int64_t n = parallel_thread_count();
+    if (n > pixels / PARALLEL_MIN_BAND_PIXELS) n = pixels / PARALLEL_MIN_BAND_PIXELS;
+    if (n > chunks) n = chunks;
+    return n < 1 ? 1 : (int)n;
+}
+
+typedef struct {
+    void (*fn)(void* task);
+    void* task;
+} ParallelJob;
+
+static void* parallel_thread_main(void* arg) {
+    ParallelJob* job = (ParallelJob*)arg;
+    job->fn(job->task);
+    return NULL;
+}
+
+void parallel_run(void (*fn)(void* task), void* tasks, int count, size_t task_size) {
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    ParallelJob jobs[PARALLEL_MAX_THREADS];
+    int started[PARALLEL_MAX_THREADS];
+    int spawned = count < PARALLEL_MAX_THREADS ? count : PARALLEL_MAX_THREADS;
+    
+    for (int i = 1; i < spawned; i++) {
+        jobs[i].fn = fn;
+        jobs[i].task = (char*)tasks + i * task_size;
+        started[i] = pthread_create(&threads[i], NULL, parallel_thread_main, &jobs[i]) == 0;
+    }
+    
+    // The caller takes the first task and any beyond the thread limit
+    if (count > 0) fn(tasks);
+    for (int i = spawned; i < count; i++) {
+        fn((char*)tasks + i * task_size);
+    }
+    
+    // Tasks whose thread could not be created run here too
+    for (int i = 1; i < spawned; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            fn(jobs[i].task);
+        }
+    }
+}
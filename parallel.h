@@ -0,0 +1,25 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PARALLEL_MIN_BAND_PIXELS (1 << 16) // Smaller bands cost more to start than they save
+
+// Minimal fork-join helper for splitting conversions across CPU cores.
+// Each task runs on its own thread (the first on the caller's) and
+// parallel_run() returns once all of them have finished.
+
+// Worker threads to use: the value set by parallel_set_thread_count(), or
+// one per online CPU when that is 0 (the default)
+int parallel_thread_count(void);
+void parallel_set_thread_count(int threads);
+
+// Number of bands for `pixels` of work split into at most `chunks` pieces:
+// at most one per thread and none smaller than PARALLEL_MIN_BAND_PIXELS
+int parallel_band_count(int64_t pixels, int64_t chunks);
+
+// Call fn on each of the count task structs in tasks (task_size bytes apart)
+void parallel_run(void (*fn)(void* task), void* tasks, int count, size_t task_size);
+
+#endif // PARALLEL_H
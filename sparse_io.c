@@ -0,0 +1,752 @@
+#include "sparse_io.h"
+#include "entropy_coder.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SPM_HEADER_SIZE 20
+#define SPM_ALIGN 8      // Alignment of every array in a mapped file
+#define MAPPED_ARRAYS 8  // Arrays a mapped channel can carry, see mapped_counts()
+#define MAPPED_QUANTIZED 0x0001  // Channel flag: values are packed 4-bit levels
+#define PREDICTOR_SHIFT 4        // Format byte: layout in the low nibble, predictor in the high one
+
+// Growable output buffer
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+} ByteBuffer;
+
+// Bounds-checked input cursor; `failed` sticks once a read runs past the end
+typedef struct {
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+    int failed;
+} ByteReader;
+
+static int buffer_reserve(ByteBuffer* buf, size_t extra) {
+    if (buf->len + extra <= buf->cap) return 1;
+    
+    size_t cap = buf->cap ? buf->cap : 256;
+    while (cap < buf->len + extra) cap *= 2;
+    
+    uint8_t* data = (uint8_t*)realloc(buf->data, cap);
+    if (!data) return 0;
+    buf->data = data;
+    buf->cap = cap;
+    return 1;
+}
+
+static int buffer_put(ByteBuffer* buf, const void* src, size_t n) {
+    if (!buffer_reserve(buf, n)) return 0;
+    memcpy(buf->data + buf->len, src, n);
+    buf->len += n;
+    return 1;
+}
+
+static int buffer_put_u8(ByteBuffer* buf, uint8_t v) {
+    return buffer_put(buf, &v, 1);
+}
+
+static int buffer_put_u16(ByteBuffer* buf, uint16_t v) {
+    uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+    return buffer_put(buf, b, 2);
+}
+
+static int buffer_put_u32(ByteBuffer* buf, uint32_t v) {
+    uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    return buffer_put(buf, b, 4);
+}
+
+static int buffer_put_u64(ByteBuffer* buf, uint64_t v) {
+    return buffer_put_u32(buf, (uint32_t)v) && buffer_put_u32(buf, (uint32_t)(v >> 32));
+}
+
+// LEB128: seven bits per byte, high bit set on all but the last byte
+static int buffer_put_varint(ByteBuffer* buf, uint64_t v) {
+    uint8_t b[10];
+    int n = 0;
+    while (v >= 0x80) {
+        b[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    b[n++] = (uint8_t)v;
+    return buffer_put(buf, b, n);
+}
+
+static uint8_t reader_u8(ByteReader* r) {
+    if (r->pos + 1 > r->len) {
+        r->failed = 1;
+        return 0;
+    }
+    return r->data[r->pos++];
+}
+
+static uint16_t reader_u16(ByteReader* r) {
+    uint16_t lo = reader_u8(r);
+    return lo | (uint16_t)(reader_u8(r) << 8);
+}
+
+static uint32_t reader_u32(ByteReader* r) {
+    uint32_t lo = reader_u16(r);
+    return lo | ((uint32_t)reader_u16(r) << 16);
+}
+
+static uint64_t reader_u64(ByteReader* r) {
+    uint64_t lo = reader_u32(r);
+    return lo | ((uint64_t)reader_u32(r) << 32);
+}
+
+static uint64_t reader_varint(ByteReader* r) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t b = reader_u8(r);
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    r->failed = 1;
+    return 0;
+}
+
+// Zero-fill up to the next SPM_ALIGN boundary
+static int buffer_pad(ByteBuffer* buf) {
+    static const uint8_t zeros[SPM_ALIGN] = { 0 };
+    return buffer_put(buf, zeros, (SPM_ALIGN - buf->len % SPM_ALIGN) % SPM_ALIGN);
+}
+
+// Append a varint length followed by the Huffman-coded block of n bytes
+static int buffer_put_coded(ByteBuffer* buf, const uint8_t* data, size_t n) {
+    uint8_t* coded = (uint8_t*)malloc(huffman_max_encoded_size(n));
+    if (!coded) return 0;
+    
+    size_t len = huffman_encode(data, n, coded);
+    int ok = buffer_put_varint(buf, len) && buffer_put(buf, coded, len);
+    
+    free(coded);
+    return ok;
+}
+
+// Append one channel: header fields, the gap stream, then the values
+static int write_channel(ByteBuffer* buf, SparseMatrix* sparse, uint16_t flags) {
+    ByteBuffer gaps = { 0 };
+    uint8_t* values = (uint8_t*)malloc(sparse->size > 0 ? (size_t)sparse->size : 1);
+    if (!values) return 0;
+    
+    SparseIterator it;
+    int row, col;
+    uint8_t value;
+    int64_t next = 0; // Linear index just past the previous non-zero
+    int64_t n = 0;
+    int ok = 1;
+    
+    sparse_iterator_init(&it, sparse);
+    while (ok && sparse_iterator_next(&it, &row, &col, &value)) {
+        int64_t idx = (int64_t)row * sparse->cols + col;
+        ok = buffer_put_varint(&gaps, (uint64_t)(idx - next));
+        values[n++] = value;
+        next = idx + 1;
+    }
+    
+    ok = ok && buffer_put_u8(buf, (uint8_t)(sparse->format | sparse->predictor << PREDICTOR_SHIFT));
+    ok = ok && buffer_put_u8(buf, sparse->threshold);
+    ok = ok && buffer_put_varint(buf, (uint64_t)sparse->rows);
+    ok = ok && buffer_put_varint(buf, (uint64_t)sparse->cols);
+    ok = ok && buffer_put_varint(buf, (uint64_t)n);
+    ok = ok && buffer_put_varint(buf, gaps.len);
+    if (flags & SPM_FLAG_ENTROPY) {
+        ok = ok && buffer_put_coded(buf, gaps.data, gaps.len);
+        ok = ok && buffer_put_coded(buf, values, (size_t)n);
+    } else {
+        ok = ok && buffer_put(buf, gaps.data, gaps.len);
+        ok = ok && buffer_put(buf, values, (size_t)n);
+    }
+    
+    free(gaps.data);
+    free(values);
+    return ok;
+}
+
+static int buffer_put_header(ByteBuffer* buf, SparseMatrix** channels, int channel_count, uint16_t flags) {
+    int ok = buffer_put(buf, SPM_MAGIC, 4);
+    ok = ok && buffer_put_u16(buf, SPM_VERSION);
+    ok = ok && buffer_put_u16(buf, flags);
+    ok = ok && buffer_put_u32(buf, (uint32_t)channels[0]->cols);
+    ok = ok && buffer_put_u32(buf, (uint32_t)channels[0]->rows);
+    ok = ok && buffer_put_u8(buf, (uint8_t)channel_count);
+    ok = ok && buffer_put_u8(buf, channels[0]->threshold);
+    ok = ok && buffer_put_u16(buf, 0);
+    return ok;
+}
+
+static int buffer_write_file(ByteBuffer* buf, const char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) return 0;
+    
+    int ok = fwrite(buf->data, 1, buf->len, file) == buf->len;
+    return (fclose(file) == 0) && ok;
+}
+
+int sparse_io_save(const char* filename, SparseMatrix** channels, int channel_count) {
+    if (!filename || !channels || channel_count <= 0 || channel_count > 255) return 0;
+    
+    // Entropy coding falls back to raw blocks by itself, so it is always on
+    uint16_t flags = SPM_FLAG_ENTROPY;
+    
+    ByteBuffer buf = { 0 };
+    int ok = buffer_put_header(&buf, channels, channel_count, flags);
+    
+    for (int ch = 0; ok && ch < channel_count; ch++) {
+        ok = write_channel(&buf, channels[ch], flags);
+    }
+    
+    ok = ok && buffer_write_file(&buf, filename);
+    
+    free(buf.data);
+    return ok;
+}
+
+// Mapped files hold arrays in host byte order, which must match the
+// little-endian header fields
+static int host_is_little_endian(void) {
+    const uint16_t probe = 1;
+    return *(const uint8_t*)&probe == 1;
+}
+
+// Element sizes of the arrays in mapped_counts() order
+static const size_t mapped_elem_size[MAPPED_ARRAYS] = {
+    sizeof(uint64_t), sizeof(int64_t), sizeof(int), sizeof(int64_t), sizeof(int), sizeof(int), sizeof(uint8_t),
+    sizeof(int64_t)
+};
+
+// Element counts of the arrays a format stores, in file order: bitmap,
+// bitmap_rank, row_idx, row_ptr, col_idx, run_len, values, value_ptr. Unused arrays
+// have a count of zero; quantized values take half a byte each.
+static void mapped_counts(SparseMatrix* sparse, size_t* counts) {
+    size_t rows = (size_t)sparse->rows;
+    size_t pixels = rows * (size_t)sparse->cols;
+    size_t size = (size_t)sparse->size;
+    size_t runs = (size_t)sparse->num_runs;
+    size_t words = (pixels + 63) / 64;
+    SparseFormat f = sparse->format;
+    
+    counts[0] = f == SPARSE_FORMAT_BITMAP ? words : 0;
+    counts[1] = f == SPARSE_FORMAT_BITMAP ? (words + BITMAP_RANK_WORDS - 1) / BITMAP_RANK_WORDS + 1 : 0;
+    counts[2] = f == SPARSE_FORMAT_COO ? size : 0;
+    counts[3] = (f == SPARSE_FORMAT_CSR || f == SPARSE_FORMAT_RLE) ? rows + 1 : 0;
+    counts[4] = f == SPARSE_FORMAT_RLE ? runs : (f == SPARSE_FORMAT_COO || f == SPARSE_FORMAT_CSR) ? size : 0;
+    counts[5] = f == SPARSE_FORMAT_RLE ? runs : 0;
+    counts[6] = f == SPARSE_FORMAT_DENSE ? pixels : size;
+    if (sparse->quantized) counts[6] = (counts[6] + 1) / 2;
+    counts[7] = f == SPARSE_FORMAT_RLE ? rows + 1 : 0;
+}
+
+static size_t mapped_array_bytes(size_t* counts, int i) {
+    size_t bytes = counts[i] * mapped_elem_size[i];
+    return (bytes + SPM_ALIGN - 1) / SPM_ALIGN * SPM_ALIGN;
+}
+
+// Append one channel in its in-memory layout: a 40-byte descriptor, then
+// each array padded to SPM_ALIGN
+static int write_mapped_channel(ByteBuffer* buf, SparseMatrix* sparse) {
+    size_t counts[MAPPED_ARRAYS];
+    mapped_counts(sparse, counts);
+    const void* arrays[MAPPED_ARRAYS] = {
+        sparse->bitmap, sparse->bitmap_rank, sparse->row_idx, sparse->row_ptr,
+        sparse->col_idx, sparse->run_len, sparse->values, sparse->value_ptr
+    };
+    
+    uint64_t payload = 0;
+    for (int i = 0; i < MAPPED_ARRAYS; i++) {
+        payload += mapped_array_bytes(counts, i);
+    }
+    
+    int ok = buffer_put_u8(buf, (uint8_t)(sparse->format | sparse->predictor << PREDICTOR_SHIFT));
+    ok = ok && buffer_put_u8(buf, sparse->threshold);
+    ok = ok && buffer_put_u16(buf, sparse->quantized ? MAPPED_QUANTIZED : 0);
+    ok = ok && buffer_put_u32(buf, (uint32_t)sparse->rows);
+    ok = ok && buffer_put_u32(buf, (uint32_t)sparse->cols);
+    ok = ok && buffer_put_u32(buf, 0);
+    ok = ok && buffer_put_u64(buf, (uint64_t)sparse->size);
+    ok = ok && buffer_put_u64(buf, (uint64_t)(sparse->format == SPARSE_FORMAT_RLE ? sparse->num_runs : 0));
+    ok = ok && buffer_put_u64(buf, payload);
+    
+    for (int i = 0; ok && i < MAPPED_ARRAYS; i++) {
+        if (counts[i] == 0) continue;
+        if ((i == 3 || i == 7) && sparse->last_row < sparse->rows) {
+            // Rows not yet reached by sparse_matrix_add() start at the total
+            uint64_t total = (uint64_t)(i == 3 && sparse->format == SPARSE_FORMAT_RLE ? sparse->num_runs : sparse->size);
+            ok = buffer_put(buf, arrays[i], ((size_t)sparse->last_row + 1) * sizeof(int64_t));
+            for (int r = sparse->last_row + 1; ok && r <= sparse->rows; r++) {
+                ok = buffer_put_u64(buf, total);
+            }
+            ok = ok && buffer_pad(buf);
+            continue;
+        }
+        ok = buffer_put(buf, arrays[i], counts[i] * mapped_elem_size[i]) && buffer_pad(buf);
+    }
+    return ok;
+}
+
+int sparse_io_save_mapped(const char* filename, SparseMatrix** channels, int channel_count) {
+    if (!filename || !channels || channel_count <= 0 || channel_count > 255) return 0;
+    if (!host_is_little_endian()) return 0;
+    
+    ByteBuffer buf = { 0 };
+    int ok = buffer_put_header(&buf, channels, channel_count, SPM_FLAG_MAPPED);
+    ok = ok && buffer_pad(&buf);
+    
+    for (int ch = 0; ok && ch < channel_count; ch++) {
+        ok = write_mapped_channel(&buf, channels[ch]);
+    }
+    
+    ok = ok && buffer_write_file(&buf, filename);
+    
+    free(buf.data);
+    return ok;
+}
+
+// Bytes this channel occupies in an entropy-coded .spm file; a measure of
+// the real information content rather than the in-memory footprint
+size_t sparse_io_encoded_size(SparseMatrix* sparse) {
+    ByteBuffer buf = { 0 };
+    size_t len = write_channel(&buf, sparse, SPM_FLAG_ENTROPY) ? buf.len : 0;
+    free(buf.data);
+    return len;
+}
+
+// Read a varint length and decode that many coded bytes into n bytes
+static uint8_t* read_coded(ByteReader* r, size_t n) {
+    uint64_t len = reader_varint(r);
+    if (r->failed || len > r->len - r->pos) return NULL;
+    
+    uint8_t* out = (uint8_t*)malloc(n > 0 ? n : 1);
+    if (out && !huffman_decode(r->data + r->pos, (size_t)len, out, n)) {
+        free(out);
+        return NULL;
+    }
+    r->pos += len;
+    return out;
+}
+
+// Decode one channel into CSR arrays and build its recorded layout from them
+static SparseMatrix* read_channel(ByteReader* r, uint16_t flags) {
+    uint8_t format = reader_u8(r);
+    uint8_t predictor = format >> PREDICTOR_SHIFT;
+    format &= (1 << PREDICTOR_SHIFT) - 1;
+    uint8_t threshold = reader_u8(r);
+    uint64_t rows = reader_varint(r);
+    uint64_t cols = reader_varint(r);
+    uint64_t nnz = reader_varint(r);
+    uint64_t gap_bytes = reader_varint(r);
+    
+    if (r->failed || format >= SPARSE_FORMAT_AUTO || predictor > SPARSE_PREDICT_PAETH || rows > INT32_MAX ||
+        cols > INT32_MAX || nnz > rows * cols || gap_bytes > 10 * nnz) {
+        return NULL;
+    }
+    
+    const uint8_t* gap_data;
+    const uint8_t* values;
+    uint8_t* decoded_gaps = NULL;
+    uint8_t* decoded_values = NULL;
+    
+    if (flags & SPM_FLAG_ENTROPY) {
+        decoded_gaps = read_coded(r, (size_t)gap_bytes);
+        decoded_values = decoded_gaps ? read_coded(r, (size_t)nnz) : NULL;
+        if (!decoded_values) {
+            free(decoded_gaps);
+            return NULL;
+        }
+        gap_data = decoded_gaps;
+        values = decoded_values;
+    } else {
+        if (gap_bytes > r->len - r->pos || nnz > r->len - r->pos - gap_bytes) return NULL;
+        gap_data = r->data + r->pos;
+        values = r->data + r->pos + gap_bytes;
+        r->pos += gap_bytes + nnz;
+    }
+    
+    // Decode straight into CSR arrays of the exact size; the entropy-decoded
+    // values are used as they are
+    int64_t* row_ptr = (int64_t*)calloc((size_t)rows + 1, sizeof(int64_t));
+    int* col_idx = (int*)malloc(sizeof(int) * (size_t)(nnz > 0 ? nnz : 1));
+    uint8_t* stored = decoded_values ? decoded_values : (uint8_t*)malloc((size_t)(nnz > 0 ? nnz : 1));
+    int ok = row_ptr && col_idx && stored;
+    if (ok && !decoded_values) memcpy(stored, values, (size_t)nnz);
+    
+    ByteReader gaps = { gap_data, (size_t)gap_bytes, 0, 0 };
+    uint64_t idx = 0;
+    for (uint64_t k = 0; ok && k < nnz; k++) {
+        idx += reader_varint(&gaps);
+        // A value at or below the threshold could never have been stored
+        if (gaps.failed || idx >= rows * cols || stored[k] <= threshold) {
+            ok = 0;
+            break;
+        }
+        row_ptr[idx / cols + 1]++;
+        col_idx[k] = (int)(idx % cols);
+        idx++;
+    }
+    // Every gap must belong to one of the nnz values
+    ok = ok && gaps.pos == gaps.len;
+    free(decoded_gaps);
+    
+    if (!ok) {
+        free(row_ptr);
+        free(col_idx);
+        free(stored);
+        return NULL;
+    }
+    
+    for (uint64_t i = 0; i < rows; i++) {
+        row_ptr[i + 1] += row_ptr[i];
+    }
+    SparseMatrix* sparse = sparse_matrix_from_csr((int)rows, (int)cols, threshold, (SparseFormat)format,
+                                                  row_ptr, col_idx, stored);
+    if (sparse) sparse->predictor = (SparsePredictor)predictor;
+    return sparse;
+}
+
+// Offsets must start at 0, never decrease and end at total
+static int offsets_valid(const int64_t* ptr, int64_t entries, int64_t total) {
+    if (ptr[0] != 0 || ptr[entries] != total) return 0;
+    for (int64_t i = 0; i < entries; i++) {
+        if (ptr[i + 1] < ptr[i]) return 0;
+    }
+    return 1;
+}
+
+// Check the per-row offsets and the bitmap rank directory of a mapped
+// channel. Both are small next to the arrays they index, so this keeps
+// the column, run and bitmap pages untouched until they are used.
+static int mapped_offsets_valid(const SparseMatrix* sparse) {
+    switch (sparse->format) {
+    case SPARSE_FORMAT_CSR:
+        return offsets_valid(sparse->row_ptr, sparse->rows, sparse->size);
+    case SPARSE_FORMAT_RLE:
+        return offsets_valid(sparse->row_ptr, sparse->rows, sparse->num_runs) &&
+               offsets_valid(sparse->value_ptr, sparse->rows, sparse->size);
+    case SPARSE_FORMAT_BITMAP: {
+        int64_t words = ((int64_t)sparse->rows * sparse->cols + 63) / 64;
+        int64_t entries = (words + BITMAP_RANK_WORDS - 1) / BITMAP_RANK_WORDS;
+        return offsets_valid(sparse->bitmap_rank, entries, sparse->size);
+    }
+    default:
+        return 1;
+    }
+}
+
+// Check every index of a mapped channel so that no reader can be sent
+// outside the mapping: offsets are monotonic and within nnz, columns (and
+// runs) lie inside the row in ascending order, and bitmap ranks match the
+// bits. Values are never checked, so their pages stay untouched.
+static int mapped_indices_valid(const SparseMatrix* sparse) {
+    int rows = sparse->rows;
+    int cols = sparse->cols;
+    
+    switch (sparse->format) {
+    case SPARSE_FORMAT_CSR:
+        if (!offsets_valid(sparse->row_ptr, rows, sparse->size)) return 0;
+        for (int i = 0; i < rows; i++) {
+            int prev = -1;
+            for (int64_t k = sparse->row_ptr[i]; k < sparse->row_ptr[i + 1]; k++) {
+                if (sparse->col_idx[k] <= prev || sparse->col_idx[k] >= cols) return 0;
+                prev = sparse->col_idx[k];
+            }
+        }
+        return 1;
+    case SPARSE_FORMAT_RLE:
+        if (!offsets_valid(sparse->row_ptr, rows, sparse->num_runs)) return 0;
+        if (!offsets_valid(sparse->value_ptr, rows, sparse->size)) return 0;
+        for (int i = 0; i < rows; i++) {
+            int end = 0;
+            int64_t pixels = 0;
+            for (int64_t r = sparse->row_ptr[i]; r < sparse->row_ptr[i + 1]; r++) {
+                int start = sparse->col_idx[r];
+                int len = sparse->run_len[r];
+                if (start < end || len < 1 || len > cols - start) return 0;
+                end = start + len;
+                pixels += len;
+            }
+            if (pixels != sparse->value_ptr[i + 1] - sparse->value_ptr[i]) return 0;
+        }
+        return 1;
+    case SPARSE_FORMAT_BITMAP: {
+        int64_t pixels = (int64_t)rows * cols;
+        int64_t words = (pixels + 63) / 64;
+        int64_t rank = 0;
+        for (int64_t w = 0; w < words; w++) {
+            if (w % BITMAP_RANK_WORDS == 0 && sparse->bitmap_rank[w / BITMAP_RANK_WORDS] != rank) return 0;
+            rank += __builtin_popcountll(sparse->bitmap[w]);
+        }
+        // No bits past the last pixel
+        if (pixels % 64 && sparse->bitmap[words - 1] >> (pixels % 64)) return 0;
+        return rank == sparse->size && sparse->bitmap_rank[(words + BITMAP_RANK_WORDS - 1) / BITMAP_RANK_WORDS] == rank;
+    }
+    case SPARSE_FORMAT_COO: {
+        int64_t prev = -1;
+        for (int64_t k = 0; k < sparse->size; k++) {
+            int row = sparse->row_idx[k];
+            int col = sparse->col_idx[k];
+            if (row < 0 || row >= rows || col < 0 || col >= cols) return 0;
+            int64_t idx = (int64_t)row * cols + col;
+            if (idx <= prev) return 0;
+            prev = idx;
+        }
+        return 1;
+    }
+    default:
+        return 1;
+    }
+}
+
+// Wrap one mapped channel without copying: the returned matrix borrows its
+// arrays from r's memory. Lengths are checked against the file and offsets
+// against the arrays they index (see mapped_offsets_valid()).
+static SparseMatrix* map_channel(ByteReader* r) {
+    uint8_t format = reader_u8(r);
+    uint8_t predictor = format >> PREDICTOR_SHIFT;
+    format &= (1 << PREDICTOR_SHIFT) - 1;
+    uint8_t threshold = reader_u8(r);
+    uint16_t channel_flags = reader_u16(r);
+    uint32_t rows = reader_u32(r);
+    uint32_t cols = reader_u32(r);
+    reader_u32(r); // reserved
+    uint64_t size = reader_u64(r);
+    uint64_t runs = reader_u64(r);
+    uint64_t payload = reader_u64(r);
+    
+    if (r->failed || format >= SPARSE_FORMAT_AUTO || predictor > SPARSE_PREDICT_PAETH ||
+        (channel_flags & ~MAPPED_QUANTIZED) ||
+        rows > INT32_MAX || cols > INT32_MAX || size > (uint64_t)rows * cols || runs > size ||
+        payload > r->len - r->pos) {
+        return NULL;
+    }
+    
+    SparseMatrix* sparse = (SparseMatrix*)calloc(1, sizeof(SparseMatrix));
+    if (!sparse) return NULL;
+    
+    sparse->format = (SparseFormat)format;
+    sparse->threshold = threshold;
+    sparse->rows = (int)rows;
+    sparse->cols = (int)cols;
+    sparse->size = (int64_t)size;
+    sparse->capacity = (int64_t)size;
+    sparse->num_runs = (int64_t)runs;
+    sparse->run_capacity = (int64_t)runs;
+    sparse->last_row = (int)rows;
+    sparse->borrowed = 1;
+    sparse->quantized = (channel_flags & MAPPED_QUANTIZED) != 0;
+    sparse->predictor = (SparsePredictor)predictor;
+    
+    size_t counts[MAPPED_ARRAYS];
+    uint8_t* arrays[MAPPED_ARRAYS];
+    uint8_t* base = (uint8_t*)r->data + r->pos;
+    uint64_t offset = 0;
+    
+    mapped_counts(sparse, counts);
+    for (int i = 0; i < MAPPED_ARRAYS; i++) {
+        arrays[i] = counts[i] ? base + offset : NULL;
+        offset += mapped_array_bytes(counts, i);
+    }
+    if (offset != payload) {
+        free(sparse);
+        return NULL;
+    }
+    r->pos += payload;
+    
+    sparse->bitmap = (uint64_t*)arrays[0];
+    sparse->bitmap_rank = (int64_t*)arrays[1];
+    sparse->row_idx = (int*)arrays[2];
+    sparse->row_ptr = (int64_t*)arrays[3];
+    sparse->col_idx = (int*)arrays[4];
+    sparse->run_len = (int*)arrays[5];
+    sparse->values = arrays[6];
+    sparse->value_ptr = (int64_t*)arrays[7];
+    
+    if (!mapped_offsets_valid(sparse)) {
+        free(sparse);
+        return NULL;
+    }
+    
+    return sparse;
+}
+
+// Check the magic and version and skip the rest of the header. Returns the
+// channel count, or 0 if this is not a readable .spm file.
+static int reader_header(ByteReader* r, uint16_t* flags) {
+    if (r->len < SPM_HEADER_SIZE || memcmp(r->data, SPM_MAGIC, 4) != 0) return 0;
+    
+    r->pos = 4;
+    uint16_t version = reader_u16(r);
+    *flags = reader_u16(r);
+    reader_u32(r); // width, repeated per channel
+    reader_u32(r); // height
+    int count = reader_u8(r);
+    reader_u8(r);  // threshold, repeated per channel
+    reader_u16(r); // reserved
+    
+    if (version != SPM_VERSION) return 0;
+    
+    // Mapped channels start on an aligned boundary
+    if (*flags & SPM_FLAG_MAPPED) r->pos = (r->pos + SPM_ALIGN - 1) / SPM_ALIGN * SPM_ALIGN;
+    return count;
+}
+
+// Read a whole file into a malloc'd buffer
+static uint8_t* read_file(const char* filename, size_t* length) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) return NULL;
+    
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    uint8_t* data = file_size > 0 ? (uint8_t*)malloc(file_size) : NULL;
+    if (data && fread(data, 1, file_size, file) != (size_t)file_size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    
+    *length = data ? (size_t)file_size : 0;
+    return data;
+}
+
+SparseMatrix** sparse_io_load(const char* filename, int* channel_count) {
+    if (!filename) return NULL;
+    
+    // Read the whole file; sparse channels are small next to the image
+    size_t length;
+    uint8_t* data = read_file(filename, &length);
+    if (!data) return NULL;
+    
+    ByteReader r = { data, length, 0, 0 };
+    uint16_t flags = 0;
+    int count = reader_header(&r, &flags);
+    
+    if (count == 0 || ((flags & SPM_FLAG_MAPPED) && !host_is_little_endian())) {
+        free(data);
+        return NULL;
+    }
+    
+    SparseMatrix** channels = (SparseMatrix**)calloc(count, sizeof(SparseMatrix*));
+    if (!channels) {
+        free(data);
+        return NULL;
+    }
+    
+    for (int ch = 0; ch < count; ch++) {
+        if (flags & SPM_FLAG_MAPPED) {
+            // The buffer goes away below, so take an owned copy
+            SparseMatrix* borrowed = map_channel(&r);
+            channels[ch] = borrowed && mapped_indices_valid(borrowed) ? sparse_matrix_convert(borrowed, borrowed->format) : NULL;
+            sparse_matrix_free(borrowed);
+        } else {
+            channels[ch] = read_channel(&r, flags);
+        }
+        if (!channels[ch]) {
+            // Cleanup on error
+            for (int i = 0; i < ch; i++) {
+                sparse_matrix_free(channels[i]);
+            }
+            free(channels);
+            free(data);
+            return NULL;
+        }
+    }
+    
+    free(data);
+    if (channel_count) *channel_count = count;
+    return channels;
+}
+
+SparseMapping* sparse_io_map(const char* filename) {
+    if (!filename || !host_is_little_endian()) return NULL;
+    
+    SparseMapping* mapping = (SparseMapping*)calloc(1, sizeof(SparseMapping));
+    if (!mapping) return NULL;
+
+#ifdef _WIN32
+    // No mmap here; read the file once and let the channels borrow from that
+    mapping->base = read_file(filename, &mapping->length);
+    if (!mapping->base) {
+        free(mapping);
+        return NULL;
+    }
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        free(mapping);
+        return NULL;
+    }
+    
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= SPM_HEADER_SIZE) {
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd); // The mapping stays valid without the descriptor
+    
+    if (base == MAP_FAILED) {
+        free(mapping);
+        return NULL;
+    }
+    mapping->base = base;
+    mapping->length = (size_t)st.st_size;
+#endif
+    
+    ByteReader r = { (const uint8_t*)mapping->base, mapping->length, 0, 0 };
+    uint16_t flags = 0;
+    int count = reader_header(&r, &flags);
+    
+    if (count > 0 && (flags & SPM_FLAG_MAPPED)) {
+        mapping->channels = (SparseMatrix**)calloc(count, sizeof(SparseMatrix*));
+    }
+    if (!mapping->channels) {
+        sparse_io_unmap(mapping);
+        return NULL;
+    }
+    
+    for (int ch = 0; ch < count; ch++) {
+        mapping->channels[ch] = map_channel(&r);
+        if (!mapping->channels[ch]) {
+            sparse_io_unmap(mapping);
+            return NULL;
+        }
+        mapping->channel_count = ch + 1;
+    }
+    
+    return mapping;
+}
+
+int sparse_io_verify(const SparseMapping* mapping) {
+    if (!mapping) return 0;
+    
+    for (int ch = 0; ch < mapping->channel_count; ch++) {
+        if (!mapped_indices_valid(mapping->channels[ch])) return 0;
+    }
+    return 1;
+}
+
+void sparse_io_unmap(SparseMapping* mapping) {
+    if (!mapping) return;
+    
+    for (int ch = 0; ch < mapping->channel_count; ch++) {
+        sparse_matrix_free(mapping->channels[ch]);
+    }
+    free(mapping->channels);
+
+#ifdef _WIN32
+    free(mapping->base);
+#else
+    if (mapping->base) munmap(mapping->base, mapping->length);
+#endif
+    free(mapping);
+}
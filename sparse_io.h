@@ -0,0 +1,64 @@
+#ifndef SPARSE_IO_H
+#define SPARSE_IO_H
+
+#include "sparse_matrix.h"
+#include <stddef.h>
+
+// Compact on-disk format (.spm) for a set of sparse channels.
+//
+// Layout (all fixed-width fields little-endian):
+//   magic "SPMF", u16 version, u16 flags,
+//   u32 width, u32 height, u8 channels, u8 threshold, u16 reserved
+// then per channel:
+//   u8 format (predictor << 4 | layout), u8 threshold,
+//   varint rows, varint cols, varint nnz, varint gap_bytes,
+//   gap_bytes of varint gaps, nnz raw values
+//
+// Non-zeros are written in row-major order. Each one is stored as the
+// number of zero pixels skipped since the previous one (a delta of the
+// linear index), so runs of neighbours cost a single byte each.
+//
+// With SPM_FLAG_ENTROPY set, the gap and value streams of each channel are
+// canonical-Huffman coded (see entropy_coder.h) and each is preceded by a
+// varint holding its coded length.
+//
+// With SPM_FLAG_MAPPED the channels are instead stored in their in-memory
+// layout, so a file can be mapped and used in place (sparse_io_map()).
+// The header is padded to 8 bytes, then per channel:
+//   u8 format (as above), u8 threshold, u16 channel_flags, u32 rows, u32 cols, u32 reserved,
+//   u64 nnz, u64 runs, u64 payload_bytes,
+//   the arrays of the format, each padded to 8 bytes
+// Channel flag 0x0001 marks values packed as 4-bit levels, two per byte
+// (see sparse_matrix_from_dense_quantized()). Streamed files always hold
+// full bytes, so quantized channels are written dequantized there.
+// Row pointers and bitmap ranks are 64-bit, as in memory. RLE channels
+// end with their per-row value offsets (rows + 1 u64).
+// Arrays are in host byte order, so mapped files are only written and
+// read on little-endian hosts.
+#define SPM_MAGIC "SPMF"
+#define SPM_VERSION 1
+#define SPM_FLAG_ENTROPY 0x0001
+#define SPM_FLAG_MAPPED  0x0002
+
+// Channels opened in place from a mapped .spm file. They borrow their
+// arrays from the mapping, are read-only, and stay valid until
+// sparse_io_unmap(). sparse_io_map() only checks the row offsets and rank
+// directories, so pages load as they are used; call sparse_io_verify() to
+// walk every column, run and bitmap word of a file that is not trusted.
+typedef struct {
+    SparseMatrix** channels;
+    int channel_count;
+    void* base;    // Start of the mapping
+    size_t length; // Bytes mapped
+} SparseMapping;
+
+// Function declarations
+int sparse_io_save(const char* filename, SparseMatrix** channels, int channel_count);
+int sparse_io_save_mapped(const char* filename, SparseMatrix** channels, int channel_count);
+SparseMatrix** sparse_io_load(const char* filename, int* channel_count);
+SparseMapping* sparse_io_map(const char* filename);
+int sparse_io_verify(const SparseMapping* mapping);
+void sparse_io_unmap(SparseMapping* mapping);
+size_t sparse_io_encoded_size(SparseMatrix* sparse);
+
+#endif // SPARSE_IO_H
@@ -0,0 +1,388 @@
+#include "sparse_kernels.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SPARSE_HAVE_X86 1
+#endif
+
+typedef int64_t (*CountFn)(const uint8_t*, int64_t, uint8_t);
+typedef int (*ScanFn)(const uint8_t*, int, uint8_t, int*);
+typedef int64_t (*MaskFn)(const uint8_t*, int64_t, uint8_t, uint64_t*);
+
+static CountFn count_impl = NULL;
+static ScanFn scan_impl = NULL;
+static CountFn runs_impl = NULL;
+static MaskFn mask_impl = NULL;
+static const char* impl_name = "scalar";
+
+// ---------------------------------------------------------------------------
+// Portable fallback: SWAR compare on 64-bit words
+// ---------------------------------------------------------------------------
+
+// High bit of each byte is set exactly when that byte passes the threshold;
+// adding at most 127 to a 7-bit value never carries into the next byte.
+static uint64_t swar_mask_above(uint64_t x, uint8_t threshold) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t low7 = 0x7F7F7F7F7F7F7F7FULL;
+    const uint64_t high = 0x8080808080808080ULL;
+    
+    if (threshold < 128) {
+        // Passes if the low 7 bits exceed threshold or the top bit is set
+        return (((x & low7) + ones * (127 - threshold)) | x) & high;
+    }
+    // Needs the top bit and low 7 bits above threshold - 128
+    return (((x & low7) + ones * (255 - threshold)) & x) & high;
+}
+
+static int64_t count_above_scalar(const uint8_t* data, int64_t n, uint8_t threshold) {
+    int64_t count = 0;
+    int64_t i = 0;
+    
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x;
+        memcpy(&x, data + i, sizeof(x));
+        count += __builtin_popcountll(swar_mask_above(x, threshold));
+    }
+    for (; i < n; i++) {
+        count += data[i] > threshold;
+    }
+    
+    return count;
+}
+
+static int scan_above_scalar(const uint8_t* data, int n, uint8_t threshold, int* out_idx) {
+    int count = 0;
+    int i = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Words with no survivors are skipped in one step; the lowest set bit
+    // maps to the lowest address on little-endian targets
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x;
+        memcpy(&x, data + i, sizeof(x));
+        uint64_t mask = swar_mask_above(x, threshold);
+        while (mask) {
+            out_idx[count++] = i + (__builtin_ctzll(mask) >> 3);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (data[i] > threshold) {
+            out_idx[count++] = i;
+        }
+    }
+    
+    return count;
+}
+
+// A run starts wherever a byte passes and the byte before it does not.
+// Shifting the flag word by one byte lines each flag up with its successor.
+static int64_t count_runs_scalar(const uint8_t* data, int64_t n, uint8_t threshold) {
+    int64_t runs = 0;
+    int prev = 0;
+    int64_t i = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x;
+        memcpy(&x, data + i, sizeof(x));
+        uint64_t mask = swar_mask_above(x, threshold);
+        uint64_t starts = mask & ~((mask << 8) | (uint64_t)(prev << 7));
+        runs += __builtin_popcountll(starts);
+        prev = (int)(mask >> 63);
+    }
+#endif
+    for (; i < n; i++) {
+        int cur = data[i] > threshold;
+        runs += cur & !prev;
+        prev = cur;
+    }
+    
+    return runs;
+}
+
+// Pack the bits of a partial trailing word one byte at a time
+static uint64_t mask_tail(const uint8_t* data, int n, uint8_t threshold) {
+    uint64_t word = 0;
+    for (int j = 0; j < n; j++) {
+        word |= (uint64_t)(data[j] > threshold) << j;
+    }
+    return word;
+}
+
+static int64_t mask_above_scalar(const uint8_t* data, int64_t n, uint8_t threshold, uint64_t* mask_out) {
+    int64_t count = 0;
+    int64_t i = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // The multiply gathers the eight per-byte flags into the top byte
+    for (; i + 64 <= n; i += 64) {
+        uint64_t word = 0;
+        for (int b = 0; b < 8; b++) {
+            uint64_t x;
+            memcpy(&x, data + i + b * 8, sizeof(x));
+            uint64_t flags = swar_mask_above(x, threshold);
+            word |= ((flags * 0x0002040810204081ULL) >> 56) << (b * 8);
+        }
+        mask_out[i / 64] = word;
+        count += __builtin_popcountll(word);
+    }
+#endif
+    for (; i < n; i += 64) {
+        int len = n - i < 64 ? (int)(n - i) : 64;
+        uint64_t word = mask_tail(data + i, len, threshold);
+        mask_out[i / 64] = word;
+        count += __builtin_popcountll(word);
+    }
+    
+    return count;
+}
+
+#ifdef SPARSE_HAVE_X86
+
+// ---------------------------------------------------------------------------
+// SSE2: 16 pixels per compare. SSE has no unsigned byte compare, so both
+// sides are biased by 0x80 and compared as signed bytes.
+// ---------------------------------------------------------------------------
+
+__attribute__((target("sse2")))
+static int64_t count_above_sse2(const uint8_t* data, int64_t n, uint8_t threshold) {
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i t = _mm_set1_epi8((char)(threshold ^ 0x80));
+    int64_t count = 0;
+    int64_t i = 0;
+    
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(data + i)), bias);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(x, t));
+        count += __builtin_popcount(mask);
+    }
+    
+    return count + count_above_scalar(data + i, n - i, threshold);
+}
+
+__attribute__((target("sse2")))
+static int scan_above_sse2(const uint8_t* data, int n, uint8_t threshold, int* out_idx) {
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i t = _mm_set1_epi8((char)(threshold ^ 0x80));
+    int count = 0;
+    int i = 0;
+    
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(data + i)), bias);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(x, t));
+        while (mask) {
+            out_idx[count++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    
+    int tail = scan_above_scalar(data + i, n - i, threshold, out_idx + count);
+    for (int k = 0; k < tail; k++) {
+        out_idx[count + k] += i;
+    }
+    
+    return count + tail;
+}
+
+__attribute__((target("sse2")))
+static int64_t count_runs_sse2(const uint8_t* data, int64_t n, uint8_t threshold) {
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i t = _mm_set1_epi8((char)(threshold ^ 0x80));
+    unsigned prev = 0;
+    int64_t runs = 0;
+    int64_t i = 0;
+    
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(data + i)), bias);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(x, t));
+        runs += __builtin_popcount(mask & ~((mask << 1) | prev));
+        prev = mask >> 15;
+    }
+    
+    // A run that continues into the tail was already counted
+    int64_t tail = count_runs_scalar(data + i, n - i, threshold);
+    if (prev && i < n && data[i] > threshold) tail--;
+    
+    return runs + tail;
+}
+
+__attribute__((target("sse2")))
+static int64_t mask_above_sse2(const uint8_t* data, int64_t n, uint8_t threshold, uint64_t* mask_out) {
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i t = _mm_set1_epi8((char)(threshold ^ 0x80));
+    int64_t count = 0;
+    int64_t i = 0;
+    
+    for (; i + 64 <= n; i += 64) {
+        uint64_t word = 0;
+        for (int b = 0; b < 4; b++) {
+            __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(data + i + b * 16)), bias);
+            word |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(x, t)) << (b * 16);
+        }
+        mask_out[i / 64] = word;
+        count += __builtin_popcountll(word);
+    }
+    if (i < n) {
+        uint64_t word = mask_tail(data + i, (int)(n - i), threshold);
+        mask_out[i / 64] = word;
+        count += __builtin_popcountll(word);
+    }
+    
+    return count;
+}
+
+// ---------------------------------------------------------------------------
+// AVX2: 32 pixels per compare
+// ---------------------------------------------------------------------------
+
+__attribute__((target("avx2")))
+static int64_t count_above_avx2(const uint8_t* data, int64_t n, uint8_t threshold) {
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    const __m256i t = _mm256_set1_epi8((char)(threshold ^ 0x80));
+    int64_t count = 0;
+    int64_t i = 0;
+    
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(data + i)), bias);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(x, t));
+        count += __builtin_popcount(mask);
+    }
+    
+    return count + count_above_sse2(data + i, n - i, threshold);
+}
+
+__attribute__((target("avx2")))
+static int scan_above_avx2(const uint8_t* data, int n, uint8_t threshold, int* out_idx) {
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    const __m256i t = _mm256_set1_epi8((char)(threshold ^ 0x80));
+    int count = 0;
+    int i = 0;
+    
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(data + i)), bias);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(x, t));
+        while (mask) {
+            out_idx[count++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    
+    int tail = scan_above_sse2(data + i, n - i, threshold, out_idx + count);
+    for (int k = 0; k < tail; k++) {
+        out_idx[count + k] += i;
+    }
+    
+    return count + tail;
+}
+
+__attribute__((target("avx2")))
+static int64_t count_runs_avx2(const uint8_t* data, int64_t n, uint8_t threshold) {
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    const __m256i t = _mm256_set1_epi8((char)(threshold ^ 0x80));
+    unsigned prev = 0;
+    int64_t runs = 0;
+    int64_t i = 0;
+    
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(data + i)), bias);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(x, t));
+        runs += __builtin_popcount(mask & ~((mask << 1) | prev));
+        prev = mask >> 31;
+    }
+    
+    int64_t tail = count_runs_sse2(data + i, n - i, threshold);
+    if (prev && i < n && data[i] > threshold) tail--;
+    
+    return runs + tail;
+}
+
+__attribute__((target("avx2")))
+static int64_t mask_above_avx2(const uint8_t* data, int64_t n, uint8_t threshold, uint64_t* mask_out) {
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    const __m256i t = _mm256_set1_epi8((char)(threshold ^ 0x80));
+    int64_t count = 0;
+    int64_t i = 0;
+    
+    for (; i + 64 <= n; i += 64) {
+        __m256i lo = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(data + i)), bias);
+        __m256i hi = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(data + i + 32)), bias);
+        uint64_t word = (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(lo, t)) |
+                        (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(hi, t)) << 32;
+        mask_out[i / 64] = word;
+        count += __builtin_popcountll(word);
+    }
+    if (i < n) {
+        uint64_t word = mask_tail(data + i, (int)(n - i), threshold);
+        mask_out[i / 64] = word;
+        count += __builtin_popcountll(word);
+    }
+    
+    return count;
+}
+
+#endif // SPARSE_HAVE_X86
+
+// ---------------------------------------------------------------------------
+// Runtime dispatch
+// ---------------------------------------------------------------------------
+
+void sparse_kernels_init(void) {
+    if (count_impl) return;
+    
+    CountFn count = count_above_scalar;
+    ScanFn scan = scan_above_scalar;
+    CountFn runs = count_runs_scalar;
+    MaskFn mask = mask_above_scalar;
+    const char* name = "scalar";
+
+#ifdef SPARSE_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        count = count_above_avx2;
+        scan = scan_above_avx2;
+        runs = count_runs_avx2;
+        mask = mask_above_avx2;
+        name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        count = count_above_sse2;
+        scan = scan_above_sse2;
+        runs = count_runs_sse2;
+        mask = mask_above_sse2;
+        name = "sse2";
+    }
+#endif
+    
+    scan_impl = scan;
+    runs_impl = runs;
+    mask_impl = mask;
+    impl_name = name;
+    count_impl = count;
+}
+
+const char* sparse_kernels_name(void) {
+    sparse_kernels_init();
+    return impl_name;
+}
+
+int64_t sparse_count_above(const uint8_t* data, int64_t n, uint8_t threshold) {
+    if (!count_impl) sparse_kernels_init();
+    return count_impl(data, n, threshold);
+}
+
+int sparse_scan_above(const uint8_t* data, int n, uint8_t threshold, int* out_idx) {
+    if (!scan_impl) sparse_kernels_init();
+    return scan_impl(data, n, threshold, out_idx);
+}
+
+int64_t sparse_count_runs_above(const uint8_t* data, int64_t n, uint8_t threshold) {
+    if (!runs_impl) sparse_kernels_init();
+    return runs_impl(data, n, threshold);
+}
+
+int64_t sparse_mask_above(const uint8_t* data, int64_t n, uint8_t threshold, uint64_t* mask_out) {
+    if (!mask_impl) sparse_kernels_init();
+    return mask_impl(data, n, threshold, mask_out);
+}
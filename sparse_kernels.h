@@ -0,0 +1,33 @@
+#ifndef SPARSE_KERNELS_H
+#define SPARSE_KERNELS_H
+
+#include <stdint.h>
+
+// Threshold scan kernels used by dense-to-sparse conversion.
+// AVX2 and SSE2 versions are picked at runtime when the CPU supports them;
+// every other target uses a portable 8-bytes-at-a-time fallback.
+
+// Select the kernels for this CPU. Called lazily by the kernels themselves;
+// call it up front before using them from several threads.
+void sparse_kernels_init(void);
+
+// Name of the selected implementation ("avx2", "sse2" or "scalar")
+const char* sparse_kernels_name(void);
+
+// Number of bytes in data[0..n) strictly greater than threshold
+int64_t sparse_count_above(const uint8_t* data, int64_t n, uint8_t threshold);
+
+// Write the index of every byte in data[0..n) strictly greater than
+// threshold to out_idx, in increasing order. Returns the number written.
+// Indices are ints, so this is meant for single rows.
+int sparse_scan_above(const uint8_t* data, int n, uint8_t threshold, int* out_idx);
+
+// Number of maximal runs of consecutive bytes strictly greater than threshold
+int64_t sparse_count_runs_above(const uint8_t* data, int64_t n, uint8_t threshold);
+
+// Write an occupancy bitmap for data[0..n): bit j of mask_out[w] is set when
+// data[w * 64 + j] is strictly greater than threshold. Writes (n + 63) / 64
+// words and returns the number of set bits.
+int64_t sparse_mask_above(const uint8_t* data, int64_t n, uint8_t threshold, uint64_t* mask_out);
+
+#endif // SPARSE_KERNELS_H
@@ -1,94 +1,1980 @@
 #include "sparse_matrix.h"
+#include "sparse_kernels.h"
+#include "parallel.h"
 #include <string.h>
 #include <stdio.h>
 
 #define INITIAL_CAPACITY 1024
+#define QUANT_STEP 17       // 255 / 15: value of one quantization level
+#define FILTER_CHUNK 4096 // Values scanned per kernel call when re-thresholding
 
-SparseMatrix* sparse_matrix_create(int rows, int cols, uint8_t threshold) {
-    SparseMatrix* matrix = (SparseMatrix*)malloc(sizeof(SparseMatrix));
+// Number of 64-bit occupancy words and rank blocks for a bitmap matrix
+static int64_t bitmap_word_count(int rows, int cols) {
+    return ((int64_t)rows * cols + 63) / 64;
+}
+
+static int64_t bitmap_block_count(int rows, int cols) {
+    return (bitmap_word_count(rows, cols) + BITMAP_RANK_WORDS - 1) / BITMAP_RANK_WORDS;
+}
+
+// Value k of the values array: a plain byte, or for quantized matrices a
+// 4-bit level (low nibble first) scaled back to 0..255
+static inline uint8_t value_at(const SparseMatrix* sparse, int64_t k) {
+    if (!sparse->quantized) return sparse->values[k];
+    return (uint8_t)(((sparse->values[k >> 1] >> ((k & 1) * 4)) & 0x0F) * QUANT_STEP);
+}
+
+// Number of set bits before pixel idx of a bitmap matrix: the rank of its
+// block plus the words and bits before it
+static int64_t bitmap_rank_before(const SparseMatrix* sparse, int64_t idx) {
+    int64_t w = idx / 64;
+    int64_t rank = sparse->bitmap_rank[w / BITMAP_RANK_WORDS];
+    for (int64_t i = w - w % BITMAP_RANK_WORDS; i < w; i++) {
+        rank += __builtin_popcountll(sparse->bitmap[i]);
+    }
+    return rank + __builtin_popcountll(sparse->bitmap[w] & (((uint64_t)1 << (idx % 64)) - 1));
+}
+
+// Number of elements (CSR) or runs (RLE) stored so far
+static inline int64_t row_total(const SparseMatrix* sparse) {
+    return sparse->format == SPARSE_FORMAT_RLE ? sparse->num_runs : sparse->size;
+}
+
+// Row pointer r of a CSR/RLE matrix. While sparse_matrix_add() appends,
+// entries past last_row are not written: those rows are still empty and
+// start at the total.
+static inline int64_t row_start(const SparseMatrix* sparse, int r) {
+    return r <= sparse->last_row ? sparse->row_ptr[r] : row_total(sparse);
+}
+
+// Offset of row r's first value in an RLE matrix, like row_start()
+static inline int64_t row_value_start(const SparseMatrix* sparse, int r) {
+    return r <= sparse->last_row ? sparse->value_ptr[r] : sparse->size;
+}
+
+// Write out the row pointers left implicit by sparse_matrix_add()
+static void close_rows(SparseMatrix* sparse) {
+    for (int r = sparse->last_row + 1; r <= sparse->rows; r++) {
+        sparse->row_ptr[r] = row_total(sparse);
+        if (sparse->value_ptr) sparse->value_ptr[r] = sparse->size;
+    }
+    sparse->last_row = sparse->rows;
+}
+
+// Storage for a matrix comes from its arena when it has one, else the heap
+static void* matrix_alloc(Arena* arena, size_t size) {
+    return arena ? arena_alloc(arena, size) : malloc(size);
+}
+
+static void* matrix_calloc(Arena* arena, size_t count, size_t size) {
+    return arena ? arena_calloc(arena, count, size) : calloc(count, size);
+}
+
+static void* matrix_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+    return arena ? arena_realloc(arena, ptr, old_size, new_size) : realloc(ptr, new_size);
+}
+
+static void matrix_release(Arena* arena, void* ptr) {
+    // Arena memory goes back with the arena
+    if (!arena) free(ptr);
+}
+
+// Allocate a matrix whose arrays hold exactly `capacity` non-zeros
+// (and `run_capacity` runs for RLE), from `arena` if not NULL
+static SparseMatrix* sparse_matrix_create_with_capacity(int rows, int cols, uint8_t threshold,
+                                                        SparseFormat format, int64_t capacity,
+                                                        int64_t run_capacity, Arena* arena) {
+    SparseMatrix* matrix = (SparseMatrix*)matrix_calloc(arena, 1, sizeof(SparseMatrix));
     if (!matrix) return NULL;
+    matrix->arena = arena;
+    
+    // Keep at least one slot so an empty matrix can still grow by doubling
+    if (capacity < 1) capacity = 1;
+    if (run_capacity < 1) run_capacity = 1;
+    
+    // AUTO only makes sense when there is data to measure
+    if (format == SPARSE_FORMAT_AUTO) format = SPARSE_FORMAT_COO;
     
+    matrix->format = format;
     matrix->rows = rows;
     matrix->cols = cols;
     matrix->threshold = threshold;
     matrix->size = 0;
-    matrix->capacity = INITIAL_CAPACITY;
-    matrix->data = (SparseNode*)malloc(sizeof(SparseNode) * matrix->capacity);
+    matrix->capacity = capacity;
+    matrix->last_row = rows; // Row pointers are all written (and zero)
     
-    if (!matrix->data) {
-        free(matrix);
+    if (format == SPARSE_FORMAT_DENSE) {
+        // Every pixel has a slot up front, all of them zero
+        int64_t pixels = (int64_t)rows * cols;
+        matrix->capacity = pixels > 0 ? pixels : 1;
+        matrix->values = (uint8_t*)matrix_calloc(arena, (size_t)matrix->capacity, sizeof(uint8_t));
+    } else {
+        matrix->values = (uint8_t*)matrix_alloc(arena, sizeof(uint8_t) * (size_t)matrix->capacity);
+    }
+    
+    int ok = 1;
+    if (format == SPARSE_FORMAT_RLE) {
+        // Runs are indexed per row like CSR, one entry per run, and each
+        // row also records where its values start
+        matrix->run_capacity = run_capacity;
+        matrix->row_ptr = (int64_t*)matrix_calloc(arena, (size_t)rows + 1, sizeof(int64_t));
+        matrix->value_ptr = (int64_t*)matrix_calloc(arena, (size_t)rows + 1, sizeof(int64_t));
+        matrix->col_idx = (int*)matrix_alloc(arena, sizeof(int) * (size_t)run_capacity);
+        matrix->run_len = (int*)matrix_alloc(arena, sizeof(int) * (size_t)run_capacity);
+        ok = matrix->row_ptr && matrix->value_ptr && matrix->col_idx && matrix->run_len;
+    } else if (format == SPARSE_FORMAT_CSR) {
+        // Every row starts out empty, so all row pointers are zero
+        matrix->row_ptr = (int64_t*)matrix_calloc(arena, (size_t)rows + 1, sizeof(int64_t));
+        matrix->col_idx = (int*)matrix_alloc(arena, sizeof(int) * (size_t)matrix->capacity);
+        ok = matrix->row_ptr && matrix->col_idx;
+    } else if (format == SPARSE_FORMAT_BITMAP) {
+        // No pixel is occupied yet, so every bit and rank starts at zero
+        int64_t words = bitmap_word_count(rows, cols);
+        matrix->bitmap = (uint64_t*)matrix_calloc(arena, words > 0 ? (size_t)words : 1, sizeof(uint64_t));
+        matrix->bitmap_rank = (int64_t*)matrix_calloc(arena, (size_t)bitmap_block_count(rows, cols) + 1,
+                                                      sizeof(int64_t));
+        ok = matrix->bitmap && matrix->bitmap_rank;
+    } else if (format == SPARSE_FORMAT_COO) {
+        matrix->row_idx = (int*)matrix_alloc(arena, sizeof(int) * (size_t)matrix->capacity);
+        matrix->col_idx = (int*)matrix_alloc(arena, sizeof(int) * (size_t)matrix->capacity);
+        ok = matrix->row_idx && matrix->col_idx;
+    }
+    
+    if (!ok || !matrix->values) {
+        sparse_matrix_free(matrix);
         return NULL;
     }
     
     return matrix;
 }
 
+SparseMatrix* sparse_matrix_create(int rows, int cols, uint8_t threshold) {
+    return sparse_matrix_create_format(rows, cols, threshold, SPARSE_FORMAT_COO);
+}
+
+SparseMatrix* sparse_matrix_create_format(int rows, int cols, uint8_t threshold, SparseFormat format) {
+    return sparse_matrix_create_arena(rows, cols, threshold, format, NULL);
+}
+
+SparseMatrix* sparse_matrix_create_arena(int rows, int cols, uint8_t threshold, SparseFormat format, Arena* arena) {
+    SparseMatrix* matrix = sparse_matrix_create_with_capacity(rows, cols, threshold, format,
+                                                              INITIAL_CAPACITY, INITIAL_CAPACITY, arena);
+    // Filled by sparse_matrix_add(), which writes row pointers as rows begin
+    if (matrix) matrix->last_row = 0;
+    return matrix;
+}
+
 void sparse_matrix_free(SparseMatrix* matrix) {
-    if (matrix) {
-        if (matrix->data) {
-            free(matrix->data);
-        }
+    if (matrix && matrix->arena) {
+        // Released with the rest of the arena
+        return;
+    }
+    if (matrix && matrix->borrowed) {
+        // Only the struct is ours; the arrays belong to the owner of the memory
         free(matrix);
+    } else if (matrix) {
+        free(matrix->row_idx);
+        free(matrix->row_ptr);
+        free(matrix->value_ptr);
+        free(matrix->col_idx);
+        free(matrix->values);
+        free(matrix->run_len);
+        free(matrix->bitmap);
+        free(matrix->bitmap_rank);
+        free(matrix);
+    }
+}
+
+// Grow storage so at least one more element fits
+static int sparse_matrix_reserve(SparseMatrix* matrix) {
+    if (matrix->size < matrix->capacity) return 1;
+    
+    int64_t new_capacity = matrix->capacity * 2;
+    
+    uint8_t* values = (uint8_t*)matrix_realloc(matrix->arena, matrix->values, sizeof(uint8_t) * (size_t)matrix->capacity,
+                                               sizeof(uint8_t) * (size_t)new_capacity);
+    if (!values) return 0;
+    matrix->values = values;
+    
+    // RLE sizes col_idx by runs (see sparse_matrix_reserve_run()) and
+    // bitmaps have no per-element index at all
+    if (matrix->format == SPARSE_FORMAT_COO || matrix->format == SPARSE_FORMAT_CSR) {
+        int* col_idx = (int*)matrix_realloc(matrix->arena, matrix->col_idx, sizeof(int) * (size_t)matrix->capacity,
+                                            sizeof(int) * (size_t)new_capacity);
+        if (!col_idx) return 0;
+        matrix->col_idx = col_idx;
     }
+    
+    if (matrix->format == SPARSE_FORMAT_COO) {
+        int* row_idx = (int*)matrix_realloc(matrix->arena, matrix->row_idx, sizeof(int) * (size_t)matrix->capacity,
+                                            sizeof(int) * (size_t)new_capacity);
+        if (!row_idx) return 0;
+        matrix->row_idx = row_idx;
+    }
+    
+    matrix->capacity = new_capacity;
+    return 1;
 }
 
-void sparse_matrix_add(SparseMatrix* matrix, int row, int col, uint8_t value) {
+// Grow RLE run storage so at least one more run fits
+static int sparse_matrix_reserve_run(SparseMatrix* matrix) {
+    if (matrix->num_runs < matrix->run_capacity) return 1;
+    
+    int64_t new_capacity = matrix->run_capacity * 2;
+    
+    int* col_idx = (int*)matrix_realloc(matrix->arena, matrix->col_idx, sizeof(int) * (size_t)matrix->run_capacity,
+                                        sizeof(int) * (size_t)new_capacity);
+    if (!col_idx) return 0;
+    matrix->col_idx = col_idx;
+    
+    int* run_len = (int*)matrix_realloc(matrix->arena, matrix->run_len, sizeof(int) * (size_t)matrix->run_capacity,
+                                        sizeof(int) * (size_t)new_capacity);
+    if (!run_len) return 0;
+    matrix->run_len = run_len;
+    
+    matrix->run_capacity = new_capacity;
+    return 1;
+}
+
+// Store one value. Every layout but DENSE takes values in row-major order
+// after the last one stored; returns 0 for out-of-order, repeated or
+// out-of-range positions, borrowed or quantized matrices and allocation
+// failures. Values at or below the threshold are skipped and return 1.
+int sparse_matrix_add(SparseMatrix* matrix, int row, int col, uint8_t value) {
+    if (row < 0 || row >= matrix->rows || col < 0 || col >= matrix->cols) return 0;
+    if (matrix->borrowed || matrix->quantized) {
+        return 0; // Borrowed and packed arrays cannot grow
+    }
     if (value <= matrix->threshold) {
-        return; // Skip values below threshold
+        return 1; // Skip values below threshold
+    }
+    
+    int in_row = 0;   // Values already stored in this row (CSR, RLE)
+    int last_col = 0; // Column of the last of them
+    if (matrix->format == SPARSE_FORMAT_CSR || matrix->format == SPARSE_FORMAT_RLE) {
+        if (matrix->last_row == matrix->rows) {
+            // Fully written row pointers: resume after the last non-empty row
+            int r = matrix->rows;
+            while (r > 0 && matrix->row_ptr[r - 1] == row_total(matrix)) r--;
+            matrix->last_row = r > 0 ? r - 1 : 0;
+        }
+        if (row < matrix->last_row) return 0;
+        
+        in_row = row == matrix->last_row && row_total(matrix) > matrix->row_ptr[row];
+        if (in_row) {
+            int64_t last = row_total(matrix) - 1;
+            last_col = matrix->col_idx[last];
+            if (matrix->format == SPARSE_FORMAT_RLE) last_col += matrix->run_len[last] - 1;
+            if (col <= last_col) return 0;
+        }
+    }
+    
+    // Lookups binary-search COO in row-major order
+    if (matrix->format == SPARSE_FORMAT_COO && matrix->size > 0) {
+        int64_t last = matrix->size - 1;
+        if (row < matrix->row_idx[last] || (row == matrix->row_idx[last] && col <= matrix->col_idx[last])) {
+            return 0;
+        }
+    }
+    
+    // Bitmap values are packed in bit order, so no bit may be set at or
+    // after this one
+    if (matrix->format == SPARSE_FORMAT_BITMAP &&
+        bitmap_rank_before(matrix, (int64_t)row * matrix->cols + col) != matrix->size) {
+        return 0;
     }
     
     // Check if we need to resize
-    if (matrix->size >= matrix->capacity) {
-        matrix->capacity *= 2;
-        matrix->data = (SparseNode*)realloc(matrix->data, sizeof(SparseNode) * matrix->capacity);
+    if (!sparse_matrix_reserve(matrix)) {
+        return 0;
     }
     
-    matrix->data[matrix->size].row = row;
-    matrix->data[matrix->size].col = col;
-    matrix->data[matrix->size].value = value;
-    matrix->size++;
+    if (matrix->format == SPARSE_FORMAT_DENSE) {
+        uint8_t* slot = &matrix->values[(int64_t)row * matrix->cols + col];
+        if (*slot == 0) matrix->size++;
+        *slot = value;
+        return 1;
+    }
+    
+    if (matrix->format == SPARSE_FORMAT_BITMAP) {
+        // Later blocks gain one value
+        int64_t idx = (int64_t)row * matrix->cols + col;
+        matrix->bitmap[idx / 64] |= (uint64_t)1 << (idx % 64);
+        int64_t blocks = bitmap_block_count(matrix->rows, matrix->cols);
+        for (int64_t b = idx / 64 / BITMAP_RANK_WORDS + 1; b <= blocks; b++) {
+            matrix->bitmap_rank[b]++;
+        }
+        matrix->values[matrix->size++] = value;
+        return 1;
+    }
+    
+    if (matrix->format == SPARSE_FORMAT_COO) {
+        matrix->row_idx[matrix->size] = row;
+        matrix->col_idx[matrix->size] = col;
+        matrix->values[matrix->size++] = value;
+        return 1;
+    }
+    
+    // A new row starts at the current total, as do the empty rows skipped
+    // on the way to it; later rows are written when they begin
+    for (int r = matrix->last_row + 1; r <= row; r++) {
+        matrix->row_ptr[r] = row_total(matrix);
+        if (matrix->value_ptr) matrix->value_ptr[r] = matrix->size;
+    }
+    matrix->last_row = row;
+    
+    if (matrix->format == SPARSE_FORMAT_RLE) {
+        // Extend the last run if this pixel directly follows it in the same row
+        if (in_row && last_col + 1 == col) {
+            matrix->run_len[matrix->num_runs - 1]++;
+        } else {
+            if (!sparse_matrix_reserve_run(matrix)) {
+                return 0;
+            }
+            matrix->col_idx[matrix->num_runs] = col;
+            matrix->run_len[matrix->num_runs] = 1;
+            matrix->num_runs++;
+        }
+        matrix->values[matrix->size++] = value;
+        return 1;
+    }
+    
+    matrix->col_idx[matrix->size] = col;
+    matrix->values[matrix->size++] = value;
+    return 1;
 }
 
 SparseMatrix* sparse_matrix_from_dense(uint8_t* dense, int rows, int cols, uint8_t threshold) {
-    SparseMatrix* sparse = sparse_matrix_create(rows, cols, threshold);
+    return sparse_matrix_from_dense_format(dense, rows, cols, threshold, SPARSE_FORMAT_COO);
+}
+
+// A slice of the plane converted by one thread. Bitmap bands cover whole
+// rank blocks of bitmap words instead of rows, so no word is shared.
+typedef struct {
+    const uint8_t* dense;
+    SparseMatrix* sparse;
+    int cols;
+    uint8_t threshold;
+    int64_t begin;      // First row (bitmap: word) of the band
+    int64_t end;        // One past the last row (bitmap: word)
+    int count_runs;     // Pass 1 also counts runs
+    int64_t nnz;        // Pass 1: survivors in the band
+    int64_t runs;       // Pass 1: runs in the band
+    int64_t offset;     // Pass 2: first value slot of the band
+    int64_t run_offset; // Pass 2: first run slot of the band (RLE)
+    int failed;         // Pass 2 ran out of memory
+} ConversionBand;
+
+// Split `units` rows (or words) into bands of whole `align` units
+static ConversionBand* conversion_bands_create(uint8_t* dense, int rows, int cols, uint8_t threshold,
+                                               int64_t units, int align, int* count) {
+    int64_t chunks = (units + align - 1) / align;
+    int n = parallel_band_count((int64_t)rows * cols, chunks);
+    
+    ConversionBand* bands = (ConversionBand*)calloc(n, sizeof(ConversionBand));
+    if (!bands) return NULL;
+    
+    // Kernel selection is lazy; do it before threads could race on it
+    if (n > 1) sparse_kernels_init();
+    
+    for (int b = 0; b < n; b++) {
+        bands[b].dense = dense;
+        bands[b].cols = cols;
+        bands[b].threshold = threshold;
+        bands[b].begin = chunks * b / n * align;
+        bands[b].end = chunks * (b + 1) / n * align;
+        if (bands[b].end > units) bands[b].end = units;
+    }
+    
+    *count = n;
+    return bands;
+}
+
+// Turn per-band counts into starting offsets; returns the totals
+static void conversion_bands_prefix(ConversionBand* bands, int count, int64_t* nnz, int64_t* runs) {
+    int64_t k = 0;
+    int64_t r = 0;
+    for (int b = 0; b < count; b++) {
+        bands[b].offset = k;
+        bands[b].run_offset = r;
+        k += bands[b].nnz;
+        r += bands[b].runs;
+    }
+    *nnz = k;
+    if (runs) *runs = r;
+}
+
+static void band_count(void* arg) {
+    ConversionBand* band = (ConversionBand*)arg;
+    for (int64_t i = band->begin; i < band->end; i++) {
+        const uint8_t* row = band->dense + i * band->cols;
+        band->nnz += sparse_count_above(row, band->cols, band->threshold);
+        if (band->count_runs) {
+            band->runs += sparse_count_runs_above(row, band->cols, band->threshold);
+        }
+    }
+}
+
+// Pass 1 over row bands: count survivors (and runs if asked) in parallel
+static ConversionBand* conversion_count(uint8_t* dense, int rows, int cols, uint8_t threshold,
+                                        int count_runs, int* count, int64_t* nnz, int64_t* runs) {
+    ConversionBand* bands = conversion_bands_create(dense, rows, cols, threshold, rows, 1, count);
+    if (!bands) return NULL;
+    
+    for (int b = 0; b < *count; b++) {
+        bands[b].count_runs = count_runs;
+    }
+    parallel_run(band_count, bands, *count, sizeof(ConversionBand));
+    conversion_bands_prefix(bands, *count, nnz, runs);
+    
+    return bands;
+}
+
+// Append row i's survivors to a COO/CSR matrix from slot k without
+// capacity checks; returns the next free slot. The scan kernel writes each
+// surviving column straight into col_idx; values are gathered after.
+static int64_t fill_row_lists(SparseMatrix* sparse, int i, const uint8_t* row, uint8_t threshold, int64_t k) {
+    int count = sparse_scan_above(row, sparse->cols, threshold, sparse->col_idx + k);
+    for (int64_t m = k; m < k + count; m++) {
+        sparse->values[m] = row[sparse->col_idx[m]];
+    }
+    if (sparse->row_idx) {
+        for (int64_t m = k; m < k + count; m++) {
+            sparse->row_idx[m] = i;
+        }
+    }
+    k += count;
+    if (sparse->format == SPARSE_FORMAT_CSR) {
+        // Row pointers are closed as soon as each row's scan ends
+        sparse->row_ptr[i + 1] = k;
+    }
+    return k;
+}
+
+// Append row i's runs to an RLE matrix: each maximal horizontal span of
+// surviving pixels becomes one run and its values are copied out with a
+// single memcpy. Advances the value cursor *k and run cursor *r.
+static void fill_row_rle(SparseMatrix* sparse, int i, const uint8_t* row, uint8_t threshold,
+                         int* scratch, int64_t* k, int64_t* r) {
+    int count = sparse_scan_above(row, sparse->cols, threshold, scratch);
+    int m = 0;
+    while (m < count) {
+        int start = scratch[m];
+        int len = 1;
+        while (m + len < count && scratch[m + len] == start + len) {
+            len++;
+        }
+        sparse->col_idx[*r] = start;
+        sparse->run_len[*r] = len;
+        memcpy(sparse->values + *k, row + start, len);
+        (*r)++;
+        *k += len;
+        m += len;
+    }
+    sparse->row_ptr[i + 1] = *r;
+    sparse->value_ptr[i + 1] = *k;
+}
+
+static void band_fill_lists(void* arg) {
+    ConversionBand* band = (ConversionBand*)arg;
+    int64_t k = band->offset;
+    for (int i = (int)band->begin; i < band->end; i++) {
+        k = fill_row_lists(band->sparse, i, band->dense + (int64_t)i * band->cols, band->threshold, k);
+    }
+}
+
+static void band_fill_rle(void* arg) {
+    ConversionBand* band = (ConversionBand*)arg;
+    int* scratch = (int*)malloc(sizeof(int) * (band->cols > 0 ? band->cols : 1));
+    if (!scratch) {
+        band->failed = 1;
+        return;
+    }
+    
+    int64_t k = band->offset;
+    int64_t r = band->run_offset;
+    for (int i = (int)band->begin; i < band->end; i++) {
+        fill_row_rle(band->sparse, i, band->dense + (int64_t)i * band->cols, band->threshold, scratch, &k, &r);
+    }
+    
+    free(scratch);
+}
+
+// Bitmap pass 1: the mask kernel writes the band's occupancy words
+static void band_mask(void* arg) {
+    ConversionBand* band = (ConversionBand*)arg;
+    SparseMatrix* sparse = band->sparse;
+    if (band->end <= band->begin) return;
+    
+    int64_t first = (int64_t)band->begin * 64;
+    int64_t last = (int64_t)band->end * 64;
+    int64_t pixels = (int64_t)sparse->rows * sparse->cols;
+    if (last > pixels) last = pixels;
+    
+    band->nnz = sparse_mask_above(band->dense + first, last - first, band->threshold,
+                                  sparse->bitmap + band->begin);
+}
+
+// Bitmap pass 2: gather surviving values word by word and fill the rank
+// entries of the band's blocks
+static void band_gather_bitmap(void* arg) {
+    ConversionBand* band = (ConversionBand*)arg;
+    SparseMatrix* sparse = band->sparse;
+    int64_t k = band->offset;
+    
+    for (int64_t w = band->begin; w < band->end; w++) {
+        if (w % BITMAP_RANK_WORDS == 0) {
+            sparse->bitmap_rank[w / BITMAP_RANK_WORDS] = k;
+        }
+        uint64_t word = sparse->bitmap[w];
+        const uint8_t* base = band->dense + w * 64;
+        while (word) {
+            sparse->values[k++] = base[__builtin_ctzll(word)];
+            word &= word - 1;
+        }
+    }
+}
+
+// Keep the band's rows as-is, zeroing pixels that do not pass the threshold
+static void band_fill_plain(void* arg) {
+    ConversionBand* band = (ConversionBand*)arg;
+    int64_t first = band->begin * band->cols;
+    int64_t last = band->end * band->cols;
+    int64_t nnz = 0;
+    
+    for (int64_t i = first; i < last; i++) {
+        uint8_t value = band->dense[i] > band->threshold ? band->dense[i] : 0;
+        band->sparse->values[i] = value;
+        nnz += value != 0;
+    }
+    band->nnz = nnz;
+}
+
+// Build a bitmap matrix: the mask kernel writes the occupancy bits, then
+// surviving values are gathered word by word
+static SparseMatrix* sparse_matrix_from_dense_bitmap(uint8_t* dense, int rows, int cols, uint8_t threshold,
+                                                     Arena* arena) {
+    SparseMatrix* sparse = sparse_matrix_create_with_capacity(rows, cols, threshold, SPARSE_FORMAT_BITMAP, 0, 0, arena);
     if (!sparse) return NULL;
     
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            uint8_t value = dense[i * cols + j];
-            if (value > threshold) {
-                sparse_matrix_add(sparse, i, j, value);
+    int count;
+    ConversionBand* bands = conversion_bands_create(dense, rows, cols, threshold,
+                                                    bitmap_word_count(rows, cols), BITMAP_RANK_WORDS, &count);
+    if (!bands) {
+        sparse_matrix_free(sparse);
+        return NULL;
+    }
+    for (int b = 0; b < count; b++) {
+        bands[b].sparse = sparse;
+    }
+    
+    parallel_run(band_mask, bands, count, sizeof(ConversionBand));
+    
+    int64_t nnz;
+    conversion_bands_prefix(bands, count, &nnz, NULL);
+    
+    uint8_t* values = (uint8_t*)matrix_realloc(arena, sparse->values, sizeof(uint8_t) * (size_t)sparse->capacity,
+                                               sizeof(uint8_t) * (size_t)(nnz > 0 ? nnz : 1));
+    if (!values) {
+        free(bands);
+        sparse_matrix_free(sparse);
+        return NULL;
+    }
+    sparse->values = values;
+    sparse->capacity = nnz > 0 ? nnz : 1;
+    
+    parallel_run(band_gather_bitmap, bands, count, sizeof(ConversionBand));
+    sparse->bitmap_rank[bitmap_block_count(rows, cols)] = nnz;
+    sparse->size = nnz;
+    
+    free(bands);
+    return sparse;
+}
+
+// Keep the plane as-is, zeroing pixels that do not pass the threshold
+static SparseMatrix* sparse_matrix_from_dense_plain(uint8_t* dense, int rows, int cols, uint8_t threshold,
+                                                    Arena* arena) {
+    SparseMatrix* sparse = sparse_matrix_create_with_capacity(rows, cols, threshold, SPARSE_FORMAT_DENSE, 0, 0, arena);
+    if (!sparse) return NULL;
+    
+    int count;
+    ConversionBand* bands = conversion_bands_create(dense, rows, cols, threshold, rows, 1, &count);
+    if (!bands) {
+        sparse_matrix_free(sparse);
+        return NULL;
+    }
+    for (int b = 0; b < count; b++) {
+        bands[b].sparse = sparse;
+    }
+    
+    parallel_run(band_fill_plain, bands, count, sizeof(ConversionBand));
+    conversion_bands_prefix(bands, count, &sparse->size, NULL);
+    
+    free(bands);
+    return sparse;
+}
+
+// A row band of a fused multi-channel conversion. Rows come from the
+// interleaved pixels, or from source when it is set. Per-channel counters
+// are `channels` int64s each; after the prefix sum offset/run_offset become
+// the band's write cursors.
+typedef struct {
+    const uint8_t* pixels;
+    SparseRowSource source;
+    void* ctx;
+    SparseMatrix** out;
+    int cols;
+    int channels;
+    uint8_t threshold;
+    int begin;       // First row of the band
+    int end;         // One past the last row
+    int count_runs;  // Pass 1 also counts runs
+    int64_t* nnz;        // Pass 1: survivors per channel
+    int64_t* runs;       // Pass 1: runs per channel
+    int64_t* offset;     // Pass 2: next value slot per channel
+    int64_t* run_offset; // Pass 2: next run slot per channel (RLE)
+    int failed;      // Ran out of memory for row scratch
+} InterleavedBand;
+
+// Split row y of the interleaved image into one row of `cols` bytes per
+// channel. Only this row-sized buffer is ever written, so it stays in cache
+// and the image itself is read sequentially.
+static void deinterleave_row(InterleavedBand* band, int y, uint8_t* planes) {
+    int cols = band->cols;
+    const uint8_t* src = band->pixels + (int64_t)y * cols * band->channels;
+    uint8_t* p = planes;
+    
+    // Fixed strides for the usual channel counts let every pixel be split
+    // in one go instead of re-reading the row per channel
+    switch (band->channels) {
+    case 2:
+        for (int x = 0; x < cols; x++, src += 2) {
+            p[x] = src[0];
+            p[cols + x] = src[1];
+        }
+        break;
+    case 3:
+        for (int x = 0; x < cols; x++, src += 3) {
+            p[x] = src[0];
+            p[cols + x] = src[1];
+            p[2 * cols + x] = src[2];
+        }
+        break;
+    case 4:
+        for (int x = 0; x < cols; x++, src += 4) {
+            p[x] = src[0];
+            p[cols + x] = src[1];
+            p[2 * cols + x] = src[2];
+            p[3 * cols + x] = src[3];
+        }
+        break;
+    default:
+        for (int ch = 0; ch < band->channels; ch++) {
+            uint8_t* dst = planes + (int64_t)ch * cols;
+            for (int x = 0; x < cols; x++) {
+                dst[x] = src[x * band->channels + ch];
+            }
+        }
+        break;
+    }
+}
+
+// Row buffer for deinterleave_row() or the source, or NULL for
+// single-channel images, whose rows can be scanned in place
+static uint8_t* interleaved_planes(InterleavedBand* band, int* ok) {
+    *ok = 1;
+    if (band->channels == 1 && !band->source) return NULL;
+    
+    uint8_t* planes = (uint8_t*)malloc((size_t)band->channels * (band->cols > 0 ? band->cols : 1));
+    *ok = planes != NULL;
+    return planes;
+}
+
+// Row y of every channel, one after another
+static const uint8_t* band_rows(InterleavedBand* band, int y, uint8_t* planes) {
+    if (band->source) {
+        band->source(band->ctx, y, planes);
+        return planes;
+    }
+    if (!planes) return band->pixels + (int64_t)y * band->cols;
+    
+    deinterleave_row(band, y, planes);
+    return planes;
+}
+
+// Pass 1: count every channel's survivors and runs
+static void band_count_interleaved(void* arg) {
+    InterleavedBand* band = (InterleavedBand*)arg;
+    int ok;
+    uint8_t* planes = interleaved_planes(band, &ok);
+    if (!ok) {
+        band->failed = 1;
+        return;
+    }
+    
+    for (int y = band->begin; y < band->end; y++) {
+        const uint8_t* rows = band_rows(band, y, planes);
+        for (int ch = 0; ch < band->channels; ch++) {
+            const uint8_t* row = rows + (int64_t)ch * band->cols;
+            band->nnz[ch] += sparse_count_above(row, band->cols, band->threshold);
+            if (band->count_runs) {
+                band->runs[ch] += sparse_count_runs_above(row, band->cols, band->threshold);
+            }
+        }
+    }
+    
+    free(planes);
+}
+
+// Set the occupancy bits and gather the values of row i of a bitmap matrix.
+// The mask kernel builds the row's bits, which are then shifted into place
+// in the plane-wide bitmap. Only the first and last word of a row can be
+// shared with another row (and so with another band), so only those are
+// merged atomically.
+static int64_t fill_row_bitmap(SparseMatrix* sparse, int i, const uint8_t* row, uint8_t threshold,
+                               uint64_t* mask, int64_t k) {
+    int cols = sparse->cols;
+    int words = (cols + 63) / 64;
+    int64_t base = (int64_t)i * cols;
+    int64_t first = base / 64;
+    int64_t last = (base + cols - 1) / 64;
+    int shift = (int)(base % 64);
+    
+    sparse_mask_above(row, cols, threshold, mask);
+    
+    for (int j = 0; j < words; j++) {
+        uint64_t word = mask[j];
+        if (!word) continue;
+        
+        // The mask has no bits past the row, so neither half spills over
+        uint64_t parts[2] = { word << shift, shift ? word >> (64 - shift) : 0 };
+        for (int h = 0; h < 2; h++) {
+            int64_t w = first + j + h;
+            if (!parts[h]) continue;
+            if (w == first || w == last) {
+                __atomic_fetch_or(&sparse->bitmap[w], parts[h], __ATOMIC_RELAXED);
+            } else {
+                sparse->bitmap[w] |= parts[h];
+            }
+        }
+        
+        const uint8_t* src = row + j * 64;
+        while (word) {
+            sparse->values[k++] = src[__builtin_ctzll(word)];
+            word &= word - 1;
+        }
+    }
+    
+    return k;
+}
+
+// Pass 2: append each channel's survivors to its matrix in that matrix's
+// own layout
+static void band_fill_interleaved(void* arg) {
+    InterleavedBand* band = (InterleavedBand*)arg;
+    int ok;
+    uint8_t* planes = interleaved_planes(band, &ok);
+    int* scratch = (int*)malloc(sizeof(int) * (band->cols > 0 ? band->cols : 1));
+    uint64_t* mask = (uint64_t*)malloc(sizeof(uint64_t) * ((band->cols + 63) / 64 + 1));
+    if (!ok || !scratch || !mask) {
+        free(planes);
+        free(scratch);
+        free(mask);
+        band->failed = 1;
+        return;
+    }
+    
+    for (int y = band->begin; y < band->end; y++) {
+        const uint8_t* rows = band_rows(band, y, planes);
+        for (int ch = 0; ch < band->channels; ch++) {
+            SparseMatrix* m = band->out[ch];
+            const uint8_t* row = rows + (int64_t)ch * band->cols;
+            
+            if (m->format == SPARSE_FORMAT_DENSE) {
+                uint8_t* plane = m->values + (int64_t)y * band->cols;
+                for (int x = 0; x < band->cols; x++) {
+                    plane[x] = row[x] > band->threshold ? row[x] : 0;
+                }
+            } else if (m->format == SPARSE_FORMAT_RLE) {
+                fill_row_rle(m, y, row, band->threshold, scratch, &band->offset[ch], &band->run_offset[ch]);
+            } else if (m->format == SPARSE_FORMAT_BITMAP) {
+                band->offset[ch] = fill_row_bitmap(m, y, row, band->threshold, mask, band->offset[ch]);
+            } else {
+                band->offset[ch] = fill_row_lists(m, y, row, band->threshold, band->offset[ch]);
+            }
+        }
+    }
+    
+    free(planes);
+    free(scratch);
+    free(mask);
+}
+
+// Bytes of a values array holding `count` values
+static size_t value_bytes(int64_t count, int quantized) {
+    return quantized ? (size_t)(count + 1) / 2 : (size_t)count * sizeof(uint8_t);
+}
+
+// Bytes a matrix of the given format would take for this many non-zeros
+// and runs; shared by format selection and sparse_matrix_get_size_bytes
+static size_t sparse_format_size_bytes(SparseFormat format, int rows, int cols, int64_t nnz, int64_t runs,
+                                       int quantized) {
+    size_t bytes = sizeof(SparseMatrix);
+    
+    switch (format) {
+    case SPARSE_FORMAT_CSR:
+        // Row pointers plus a column index and value per non-zero
+        bytes += ((size_t)rows + 1) * sizeof(int64_t) + (size_t)nnz * sizeof(int) + value_bytes(nnz, quantized);
+        break;
+    case SPARSE_FORMAT_RLE:
+        // Run and value offsets per row, one (start, length) pair per run,
+        // packed values
+        bytes += ((size_t)rows + 1) * 2 * sizeof(int64_t) + (size_t)runs * 2 * sizeof(int) +
+                 value_bytes(nnz, quantized);
+        break;
+    case SPARSE_FORMAT_BITMAP:
+        // One bit per pixel, the rank directory and packed values
+        bytes += (size_t)bitmap_word_count(rows, cols) * sizeof(uint64_t) +
+                 ((size_t)bitmap_block_count(rows, cols) + 1) * sizeof(int64_t) + value_bytes(nnz, quantized);
+        break;
+    case SPARSE_FORMAT_DENSE:
+        bytes += value_bytes((int64_t)rows * cols, quantized);
+        break;
+    default:
+        // COO: row index, column index and value per non-zero
+        bytes += (size_t)nnz * 2 * sizeof(int) + value_bytes(nnz, quantized);
+        break;
+    }
+    
+    return bytes;
+}
+
+// Layout with the smallest footprint for these counts
+static SparseFormat smallest_format(int rows, int cols, int64_t nnz, int64_t runs, int quantized) {
+    // Ties go to the earlier, simpler format
+    static const SparseFormat candidates[] = {
+        SPARSE_FORMAT_DENSE, SPARSE_FORMAT_CSR, SPARSE_FORMAT_RLE, SPARSE_FORMAT_BITMAP
+    };
+    SparseFormat best = SPARSE_FORMAT_COO;
+    size_t best_bytes = sparse_format_size_bytes(best, rows, cols, nnz, runs, quantized);
+    for (size_t c = 0; c < sizeof(candidates) / sizeof(candidates[0]); c++) {
+        size_t bytes = sparse_format_size_bytes(candidates[c], rows, cols, nnz, runs, quantized);
+        if (bytes < best_bytes) {
+            best = candidates[c];
+            best_bytes = bytes;
+        }
+    }
+    
+    return best;
+}
+
+// Pick the layout that stores this plane in the fewest bytes. Counting
+// survivors and runs is a cheap SIMD pass compared to the conversion itself.
+SparseFormat sparse_matrix_choose_format(uint8_t* dense, int rows, int cols, uint8_t threshold) {
+    int count;
+    int64_t nnz, runs;
+    ConversionBand* bands = conversion_count(dense, rows, cols, threshold, 1, &count, &nnz, &runs);
+    if (!bands) return SPARSE_FORMAT_COO;
+    free(bands);
+    
+    return smallest_format(rows, cols, nnz, runs, 0);
+}
+
+// Conversion runs in row bands on worker threads. Pass 1 counts each
+// band's survivors, a prefix sum over the counts gives every band its
+// slice of the exactly-sized arrays, and pass 2 fills the slices in
+// parallel, so the result is in row-major order as if built serially.
+SparseMatrix* sparse_matrix_from_dense_format(uint8_t* dense, int rows, int cols, uint8_t threshold, SparseFormat format) {
+    return sparse_matrix_from_dense_arena(dense, rows, cols, threshold, format, NULL);
+}
+
+SparseMatrix* sparse_matrix_from_dense_arena(uint8_t* dense, int rows, int cols, uint8_t threshold,
+                                             SparseFormat format, Arena* arena) {
+    if (format == SPARSE_FORMAT_DENSE) {
+        return sparse_matrix_from_dense_plain(dense, rows, cols, threshold, arena);
+    }
+    if (format == SPARSE_FORMAT_BITMAP) {
+        return sparse_matrix_from_dense_bitmap(dense, rows, cols, threshold, arena);
+    }
+    
+    // Runs only matter to RLE and to format selection
+    int count;
+    int64_t nnz, runs;
+    int count_runs = format == SPARSE_FORMAT_RLE || format == SPARSE_FORMAT_AUTO;
+    ConversionBand* bands = conversion_count(dense, rows, cols, threshold, count_runs, &count, &nnz, &runs);
+    if (!bands) return NULL;
+    
+    // The counts already gathered are all AUTO needs
+    if (format == SPARSE_FORMAT_AUTO) {
+        format = smallest_format(rows, cols, nnz, runs, 0);
+    }
+    if (format == SPARSE_FORMAT_DENSE || format == SPARSE_FORMAT_BITMAP) {
+        free(bands);
+        return sparse_matrix_from_dense_arena(dense, rows, cols, threshold, format, arena);
+    }
+    
+    SparseMatrix* sparse = sparse_matrix_create_with_capacity(rows, cols, threshold, format, nnz, runs, arena);
+    if (!sparse) {
+        free(bands);
+        return NULL;
+    }
+    
+    int failed = 0;
+    for (int b = 0; b < count; b++) {
+        bands[b].sparse = sparse;
+    }
+    parallel_run(format == SPARSE_FORMAT_RLE ? band_fill_rle : band_fill_lists,
+                 bands, count, sizeof(ConversionBand));
+    for (int b = 0; b < count; b++) {
+        failed |= bands[b].failed;
+    }
+    free(bands);
+    
+    if (failed) {
+        sparse_matrix_free(sparse);
+        return NULL;
+    }
+    
+    sparse->size = nnz;
+    if (format == SPARSE_FORMAT_RLE) sparse->num_runs = runs;
+    return sparse;
+}
+
+// Convert with values quantized to 16 levels and packed two per byte, low
+// nibble first. Every survivor is lifted to at least the lowest level that
+// dequantizes above the threshold, so the set of non-zeros, and with it the
+// index arrays, is exactly that of the unquantized conversion and survives
+// a dequantized round trip. Readers scale levels back by QUANT_STEP.
+SparseMatrix* sparse_matrix_from_dense_quantized(uint8_t* dense, int rows, int cols, uint8_t threshold,
+                                                 SparseFormat format) {
+    if (format == SPARSE_FORMAT_AUTO) {
+        // Halved values shift the balance towards the index-heavy layouts
+        int count;
+        int64_t nnz, runs;
+        ConversionBand* bands = conversion_count(dense, rows, cols, threshold, 1, &count, &nnz, &runs);
+        if (!bands) return NULL;
+        free(bands);
+        format = smallest_format(rows, cols, nnz, runs, 1);
+    }
+    
+    SparseMatrix* sparse = sparse_matrix_from_dense_arena(dense, rows, cols, threshold, format, NULL);
+    if (!sparse) return NULL;
+    
+    // Pack in place: byte k / 2 is only written after values k and k + 1
+    // have been read
+    int64_t n = sparse->format == SPARSE_FORMAT_DENSE ? (int64_t)rows * cols : sparse->size;
+    uint8_t* values = sparse->values;
+    uint8_t min_level = (uint8_t)(threshold / QUANT_STEP + 1); // At most 15: survivors need threshold < 255
+    for (int64_t k = 0; k < n; k++) {
+        uint8_t v = values[k];
+        uint8_t q = (uint8_t)((v * 15 + 127) / 255);
+        if (v != 0 && q < min_level) q = min_level;
+        if (k & 1) {
+            values[k >> 1] |= (uint8_t)(q << 4);
+        } else {
+            values[k >> 1] = q;
+        }
+    }
+    
+    size_t packed = n > 1 ? (size_t)(n + 1) / 2 : 1;
+    uint8_t* shrunk = (uint8_t*)matrix_realloc(NULL, values, (size_t)(n > 0 ? n : 1), packed);
+    if (shrunk) sparse->values = shrunk;
+    sparse->quantized = 1;
+    return sparse;
+}
+
+// Signed residual to and from its zigzag byte (0, -1, 1, -2, ... as 0, 1, 2, 3, ...)
+static inline uint8_t zigzag(int8_t r) {
+    return (uint8_t)((r * 2) ^ (r >> 7));
+}
+
+static inline int8_t unzigzag(uint8_t z) {
+    return (int8_t)((z >> 1) ^ -(z & 1));
+}
+
+// Prediction from the left (a), upper (b) and upper-left (c) neighbours,
+// each 0 outside the plane
+static inline uint8_t predict(SparsePredictor predictor, int a, int b, int c) {
+    switch (predictor) {
+    case SPARSE_PREDICT_LEFT:
+        return (uint8_t)a;
+    case SPARSE_PREDICT_UP:
+        return (uint8_t)b;
+    case SPARSE_PREDICT_AVERAGE:
+        return (uint8_t)((a + b) >> 1);
+    case SPARSE_PREDICT_PAETH: {
+        int p = a + b - c;
+        int pa = abs(p - a);
+        int pb = abs(p - b);
+        int pc = abs(p - c);
+        if (pa <= pb && pa <= pc) return (uint8_t)a;
+        return (uint8_t)(pb <= pc ? b : c);
+    }
+    default:
+        return 0;
+    }
+}
+
+// Replace the residuals at plane[row * pitch + col * stride] by pixels,
+// in row-major order so every prediction reads decoded neighbours
+static void unpredict(SparsePredictor predictor, uint8_t* plane, int rows, int cols, int64_t pitch, int stride) {
+    for (int y = 0; y < rows; y++) {
+        uint8_t* row = plane + y * pitch;
+        uint8_t* up = y > 0 ? row - pitch : NULL;
+        for (int x = 0; x < cols; x++) {
+            int64_t at = (int64_t)x * stride;
+            int a = x > 0 ? row[at - stride] : 0;
+            int b = up ? up[at] : 0;
+            int c = up && x > 0 ? up[at - stride] : 0;
+            row[at] = (uint8_t)(predict(predictor, a, b, c) + unzigzag(row[at]));
+        }
+    }
+}
+
+// Convert the residuals of a predictor instead of the pixels. Residuals
+// whose magnitude is at most the threshold are dropped, and prediction runs
+// on the pixels the decoder will see (closed loop), so a dropped residual
+// costs at most `threshold` on its own pixel and never drifts into the
+// following ones. Residuals are stored modulo 256, so a large difference
+// can wrap to a small code; the threshold is therefore applied here and the
+// matrix itself records a threshold of 0.
+SparseMatrix* sparse_matrix_from_dense_predicted(uint8_t* dense, int rows, int cols, uint8_t threshold,
+                                                 SparseFormat format, SparsePredictor predictor) {
+    if (predictor == SPARSE_PREDICT_NONE) {
+        return sparse_matrix_from_dense_format(dense, rows, cols, threshold, format);
+    }
+    
+    // The residual plane, plus the decoded previous and current rows
+    uint8_t* residuals = (uint8_t*)malloc((size_t)rows * cols * sizeof(uint8_t));
+    uint8_t* decoded = (uint8_t*)malloc((size_t)cols * 2 * sizeof(uint8_t));
+    if (!residuals || !decoded) {
+        free(residuals);
+        free(decoded);
+        return NULL;
+    }
+    
+    uint8_t* up = decoded;
+    uint8_t* cur = decoded + cols;
+    for (int y = 0; y < rows; y++) {
+        const uint8_t* src = dense + (int64_t)y * cols;
+        uint8_t* out = residuals + (int64_t)y * cols;
+        for (int x = 0; x < cols; x++) {
+            int a = x > 0 ? cur[x - 1] : 0;
+            int b = y > 0 ? up[x] : 0;
+            int c = y > 0 && x > 0 ? up[x - 1] : 0;
+            uint8_t p = predict(predictor, a, b, c);
+            if (abs(src[x] - p) > threshold) {
+                out[x] = zigzag((int8_t)(uint8_t)(src[x] - p));
+                cur[x] = src[x];
+            } else {
+                out[x] = 0;
+                cur[x] = p;
             }
         }
+        uint8_t* swap = up;
+        up = cur;
+        cur = swap;
     }
+    free(decoded);
     
+    SparseMatrix* sparse = sparse_matrix_from_dense_arena(residuals, rows, cols, 0, format, NULL);
+    free(residuals);
+    if (sparse) sparse->predictor = predictor;
     return sparse;
 }
 
+// Shared by the interleaved and row-source conversions: count every
+// channel's survivors band by band, size each matrix exactly, then fill
+static int sparse_matrices_from_bands(const uint8_t* pixels, SparseRowSource source, void* ctx, int rows,
+                                      int cols, int channels, uint8_t threshold, SparseFormat format,
+                                      SparseMatrix** out, Arena* arena) {
+    if (channels <= 0) return 0;
+    
+    int n = parallel_band_count((int64_t)rows * cols * channels, rows);
+    if (n > 1) sparse_kernels_init();
+    
+    InterleavedBand* bands = (InterleavedBand*)calloc(n, sizeof(InterleavedBand));
+    int64_t* counters = (int64_t*)calloc((size_t)n * 4 * channels, sizeof(int64_t));
+    int64_t* totals = (int64_t*)calloc((size_t)2 * channels, sizeof(int64_t));
+    int ok = bands && counters && totals;
+    
+    for (int ch = 0; ch < channels; ch++) {
+        out[ch] = NULL;
+    }
+    
+    for (int b = 0; ok && b < n; b++) {
+        int64_t* base = counters + (size_t)b * 4 * channels;
+        bands[b].pixels = pixels;
+        bands[b].source = source;
+        bands[b].ctx = ctx;
+        bands[b].out = out;
+        bands[b].cols = cols;
+        bands[b].channels = channels;
+        bands[b].threshold = threshold;
+        bands[b].begin = (int)((int64_t)rows * b / n);
+        bands[b].end = (int)((int64_t)rows * (b + 1) / n);
+        bands[b].count_runs = format == SPARSE_FORMAT_RLE || format == SPARSE_FORMAT_AUTO;
+        bands[b].nnz = base;
+        bands[b].runs = base + channels;
+        bands[b].offset = base + 2 * channels;
+        bands[b].run_offset = base + 3 * channels;
+    }
+    
+    if (ok) {
+        parallel_run(band_count_interleaved, bands, n, sizeof(InterleavedBand));
+        for (int b = 0; b < n; b++) {
+            ok &= !bands[b].failed;
+        }
+    }
+    
+    // Prefix sums per channel, then size every matrix exactly
+    for (int ch = 0; ok && ch < channels; ch++) {
+        int64_t* nnz = &totals[ch];
+        int64_t* runs = &totals[channels + ch];
+        for (int b = 0; b < n; b++) {
+            bands[b].offset[ch] = *nnz;
+            bands[b].run_offset[ch] = *runs;
+            *nnz += bands[b].nnz[ch];
+            *runs += bands[b].runs[ch];
+        }
+        
+        SparseFormat f = format == SPARSE_FORMAT_AUTO ? smallest_format(rows, cols, *nnz, *runs, 0) : format;
+        out[ch] = sparse_matrix_create_with_capacity(rows, cols, threshold, f, *nnz, *runs, arena);
+        ok = out[ch] != NULL;
+    }
+    
+    if (ok) {
+        parallel_run(band_fill_interleaved, bands, n, sizeof(InterleavedBand));
+        for (int b = 0; b < n; b++) {
+            ok &= !bands[b].failed;
+        }
+    }
+    
+    for (int ch = 0; ok && ch < channels; ch++) {
+        SparseMatrix* m = out[ch];
+        m->size = totals[ch];
+        if (m->format == SPARSE_FORMAT_RLE) {
+            m->num_runs = totals[channels + ch];
+        } else if (m->format == SPARSE_FORMAT_BITMAP) {
+            // Ranks need every word settled, so they come last
+            int64_t words = bitmap_word_count(rows, cols);
+            int64_t k = 0;
+            for (int64_t w = 0; w < words; w++) {
+                if (w % BITMAP_RANK_WORDS == 0) m->bitmap_rank[w / BITMAP_RANK_WORDS] = k;
+                k += __builtin_popcountll(m->bitmap[w]);
+            }
+            m->bitmap_rank[bitmap_block_count(rows, cols)] = k;
+        }
+    }
+    
+    if (!ok) {
+        for (int ch = 0; ch < channels; ch++) {
+            sparse_matrix_free(out[ch]);
+            out[ch] = NULL;
+        }
+    }
+    
+    free(bands);
+    free(counters);
+    free(totals);
+    return ok;
+}
+
+// Convert every channel of an interleaved image (channel c of pixel i at
+// pixels[i * channels + c]) without extracting whole planes: each row is
+// split into a small per-thread buffer and scanned for all channels while
+// it is still in cache. Counting and filling both run over row bands on
+// worker threads. Returns 1 on success with out[0..channels) set, 0 on
+// allocation failure.
+int sparse_matrices_from_interleaved(const uint8_t* pixels, int rows, int cols, int channels,
+                                     uint8_t threshold, SparseFormat format, SparseMatrix** out) {
+    return sparse_matrices_from_interleaved_arena(pixels, rows, cols, channels, threshold, format, out, NULL);
+}
+
+int sparse_matrices_from_interleaved_arena(const uint8_t* pixels, int rows, int cols, int channels,
+                                           uint8_t threshold, SparseFormat format, SparseMatrix** out,
+                                           Arena* arena) {
+    return sparse_matrices_from_bands(pixels, NULL, NULL, rows, cols, channels, threshold, format, out, arena);
+}
+
+// Rows are produced twice, once per pass, and only a row-sized buffer per
+// band ever holds them
+int sparse_matrices_from_rows(SparseRowSource source, void* ctx, int rows, int cols, int channels,
+                              uint8_t threshold, SparseFormat format, SparseMatrix** out) {
+    return sparse_matrices_from_bands(NULL, source, ctx, rows, cols, channels, threshold, format, out, NULL);
+}
+
 void sparse_matrix_to_dense(SparseMatrix* sparse, uint8_t* dense) {
     // Initialize all to zero
-    memset(dense, 0, sparse->rows * sparse->cols * sizeof(uint8_t));
+    memset(dense, 0, (size_t)sparse->rows * sparse->cols * sizeof(uint8_t));
+    sparse_matrix_scatter(sparse, dense, 1);
+}
+
+// sparse_matrix_scatter() with the stored values decoded by `predictor`
+// rather than the matrix's own, so residuals can be placed as they are
+static void scatter(SparseMatrix* sparse, SparsePredictor predictor, uint8_t* dense, int stride) {
+    int cols = sparse->cols;
+    
+    if (predictor != SPARSE_PREDICT_NONE) {
+        // Place the residuals, then decode every pixel from them
+        scatter(sparse, SPARSE_PREDICT_NONE, dense, stride);
+        unpredict(predictor, dense, sparse->rows, cols, (int64_t)cols * stride, stride);
+        return;
+    }
+    
+    if (sparse->quantized) {
+        // Packed levels are expanded one at a time by the iterator
+        SparseIterator it;
+        int row, col;
+        uint8_t value;
+        sparse_iterator_init(&it, sparse);
+        while (sparse_iterator_next(&it, &row, &col, &value)) {
+            dense[((int64_t)row * cols + col) * stride] = value;
+        }
+        return;
+    }
+    
+    if (sparse->format == SPARSE_FORMAT_DENSE) {
+        int64_t n = (int64_t)sparse->rows * cols;
+        if (stride == 1) {
+            memcpy(dense, sparse->values, (size_t)n * sizeof(uint8_t));
+            return;
+        }
+        for (int64_t i = 0; i < n; i++) {
+            dense[i * stride] = sparse->values[i];
+        }
+        return;
+    }
+    
+    if (sparse->format == SPARSE_FORMAT_BITMAP) {
+        // Values are packed in bit order, so walk the set bits of each word
+        int64_t words = bitmap_word_count(sparse->rows, cols);
+        int64_t k = 0;
+        for (int64_t w = 0; w < words; w++) {
+            uint64_t word = sparse->bitmap[w];
+            uint8_t* base = dense + w * 64 * stride;
+            while (word) {
+                base[__builtin_ctzll(word) * stride] = sparse->values[k++];
+                word &= word - 1;
+            }
+        }
+        return;
+    }
+    
+    if (sparse->format == SPARSE_FORMAT_RLE) {
+        // One bulk copy per run when contiguous; values are packed in run order
+        const uint8_t* values = sparse->values;
+        for (int i = 0; i < sparse->rows; i++) {
+            uint8_t* row = dense + (int64_t)i * cols * stride;
+            for (int64_t r = row_start(sparse, i); r < row_start(sparse, i + 1); r++) {
+                uint8_t* dst = row + sparse->col_idx[r] * stride;
+                int len = sparse->run_len[r];
+                if (stride == 1) {
+                    memcpy(dst, values, len);
+                } else {
+                    for (int j = 0; j < len; j++) {
+                        dst[j * stride] = values[j];
+                    }
+                }
+                values += len;
+            }
+        }
+        return;
+    }
+    
+    if (sparse->format == SPARSE_FORMAT_CSR) {
+        // Walk rows in order so writes stream through the output
+        for (int i = 0; i < sparse->rows; i++) {
+            uint8_t* row = dense + (int64_t)i * cols * stride;
+            for (int64_t k = row_start(sparse, i); k < row_start(sparse, i + 1); k++) {
+                row[sparse->col_idx[k] * stride] = sparse->values[k];
+            }
+        }
+        return;
+    }
     
     // Fill in non-zero values
-    for (int i = 0; i < sparse->size; i++) {
-        int idx = sparse->data[i].row * sparse->cols + sparse->data[i].col;
-        dense[idx] = sparse->data[i].value;
+    for (int64_t i = 0; i < sparse->size; i++) {
+        int64_t idx = (int64_t)sparse->row_idx[i] * cols + sparse->col_idx[i];
+        dense[idx * stride] = sparse->values[i];
+    }
+}
+
+// Write every non-zero to dense[(row * cols + col) * stride], leaving all
+// other bytes untouched. A stride of the channel count writes one channel
+// of an interleaved image in place. Predicted matrices write every pixel
+// and expect the untouched bytes to be zero.
+void sparse_matrix_scatter(SparseMatrix* sparse, uint8_t* dense, int stride) {
+    scatter(sparse, sparse->predictor, dense, stride);
+}
+
+// Position of the first element in [lo, hi) of a sorted array that is >= key
+static int64_t lower_bound(const int* a, int64_t lo, int64_t hi, int key) {
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (a[mid] < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Value at (row, col), or 0 if it was below the threshold. Lookups assume
+// the non-zeros are in row-major order, as sparse_matrix_from_dense builds them.
+uint8_t sparse_matrix_get(SparseMatrix* sparse, int row, int col) {
+    if (row < 0 || row >= sparse->rows || col < 0 || col >= sparse->cols) return 0;
+    
+    if (sparse->predictor != SPARSE_PREDICT_NONE) {
+        // A predicted pixel depends on everything above and to its left
+        uint8_t value = 0;
+        sparse_matrix_to_dense_region(sparse, col, row, 1, 1, &value);
+        return value;
+    }
+    
+    switch (sparse->format) {
+    case SPARSE_FORMAT_DENSE:
+        return value_at(sparse, (int64_t)row * sparse->cols + col);
+    case SPARSE_FORMAT_CSR: {
+        int64_t lo = row_start(sparse, row);
+        int64_t hi = row_start(sparse, row + 1);
+        int64_t k = lower_bound(sparse->col_idx, lo, hi, col);
+        return (k < hi && sparse->col_idx[k] == col) ? value_at(sparse, k) : 0;
+    }
+    case SPARSE_FORMAT_RLE: {
+        // Binary search for the last run starting at or before col, then
+        // sum the lengths of the runs before it in this row
+        int64_t first = row_start(sparse, row);
+        int64_t r = lower_bound(sparse->col_idx, first, row_start(sparse, row + 1), col + 1) - 1;
+        if (r < first || col >= sparse->col_idx[r] + sparse->run_len[r]) return 0;
+        
+        int64_t offset = row_value_start(sparse, row);
+        for (int64_t p = first; p < r; p++) {
+            offset += sparse->run_len[p];
+        }
+        return value_at(sparse, offset + col - sparse->col_idx[r]);
+    }
+    case SPARSE_FORMAT_BITMAP: {
+        int64_t idx = (int64_t)row * sparse->cols + col;
+        if (!(sparse->bitmap[idx / 64] & ((uint64_t)1 << (idx % 64)))) return 0;
+        return value_at(sparse, bitmap_rank_before(sparse, idx));
+    }
+    default: {
+        // COO: binary search for the row, then for the column within it
+        int64_t lo = lower_bound(sparse->row_idx, 0, sparse->size, row);
+        int64_t hi = lower_bound(sparse->row_idx, lo, sparse->size, row + 1);
+        int64_t k = lower_bound(sparse->col_idx, lo, hi, col);
+        return (k < hi && sparse->col_idx[k] == col) ? value_at(sparse, k) : 0;
+    }
+    }
+}
+
+// Copy the values of row `row` with columns in [x0, x1) into out, where out
+// corresponds to column x0. Each layout jumps straight to the row and then
+// to the first column, so only elements inside the range are touched.
+static void region_row(SparseMatrix* sparse, int row, int x0, int x1, uint8_t* out) {
+    switch (sparse->format) {
+    case SPARSE_FORMAT_DENSE: {
+        int64_t base = (int64_t)row * sparse->cols;
+        if (!sparse->quantized) {
+            memcpy(out, sparse->values + base + x0, x1 - x0);
+            return;
+        }
+        for (int x = x0; x < x1; x++) {
+            out[x - x0] = value_at(sparse, base + x);
+        }
+        return;
+    }
+    case SPARSE_FORMAT_CSR: {
+        int64_t hi = row_start(sparse, row + 1);
+        for (int64_t k = lower_bound(sparse->col_idx, row_start(sparse, row), hi, x0);
+             k < hi && sparse->col_idx[k] < x1; k++) {
+            out[sparse->col_idx[k] - x0] = value_at(sparse, k);
+        }
+        return;
+    }
+    case SPARSE_FORMAT_RLE: {
+        int64_t offset = row_value_start(sparse, row);
+        for (int64_t r = row_start(sparse, row); r < row_start(sparse, row + 1); r++) {
+            int start = sparse->col_idx[r];
+            int end = start + sparse->run_len[r];
+            if (start >= x1) break;
+            if (end > x0) {
+                int from = start > x0 ? start : x0;
+                int to = end < x1 ? end : x1;
+                if (!sparse->quantized) {
+                    memcpy(out + (from - x0), sparse->values + offset + (from - start), to - from);
+                } else {
+                    for (int x = from; x < to; x++) {
+                        out[x - x0] = value_at(sparse, offset + (x - start));
+                    }
+                }
+            }
+            offset += sparse->run_len[r];
+        }
+        return;
+    }
+    case SPARSE_FORMAT_BITMAP: {
+        int64_t first = (int64_t)row * sparse->cols + x0;
+        int64_t last = (int64_t)row * sparse->cols + x1;
+        int64_t w = first / 64;
+        
+        // Rank of the first bit in range: block rank plus the words before it
+        int64_t k = sparse->bitmap_rank[w / BITMAP_RANK_WORDS];
+        for (int64_t i = w - w % BITMAP_RANK_WORDS; i < w; i++) {
+            k += __builtin_popcountll(sparse->bitmap[i]);
+        }
+        uint64_t word = sparse->bitmap[w];
+        k += __builtin_popcountll(word & (((uint64_t)1 << (first % 64)) - 1));
+        word &= ~(uint64_t)0 << (first % 64);
+        
+        for (; w * 64 < last; w++) {
+            if (w * 64 >= first) word = sparse->bitmap[w];
+            while (word) {
+                int64_t idx = w * 64 + __builtin_ctzll(word);
+                if (idx >= last) return;
+                out[idx - first] = value_at(sparse, k++);
+                word &= word - 1;
+            }
+        }
+        return;
+    }
+    default: {
+        // COO: binary search for the row, then for the first column
+        int64_t lo = lower_bound(sparse->row_idx, 0, sparse->size, row);
+        int64_t hi = lower_bound(sparse->row_idx, lo, sparse->size, row + 1);
+        for (int64_t k = lower_bound(sparse->col_idx, lo, hi, x0); k < hi && sparse->col_idx[k] < x1; k++) {
+            out[sparse->col_idx[k] - x0] = value_at(sparse, k);
+        }
+        return;
+    }
+    }
+}
+
+// Reconstruct only the rectangle (x, y, width, height) into a width * height
+// buffer; parts outside the matrix are zero. Work is proportional to the
+// rectangle (plus a binary search per row), not to the whole plane.
+// Predicted matrices decode from the top-left corner of the plane to the
+// far corner of the rectangle.
+void sparse_matrix_to_dense_region(SparseMatrix* sparse, int x, int y, int width, int height, uint8_t* dense) {
+    if (width <= 0 || height <= 0) return;
+    memset(dense, 0, (size_t)width * height * sizeof(uint8_t));
+    
+    // Clip the rectangle to the matrix
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = (int64_t)x + width < sparse->cols ? x + width : sparse->cols;
+    int y1 = (int64_t)y + height < sparse->rows ? y + height : sparse->rows;
+    if (x0 >= x1 || y0 >= y1) return;
+    
+    if (sparse->predictor != SPARSE_PREDICT_NONE) {
+        uint8_t* scratch = (uint8_t*)calloc((size_t)y1 * x1, sizeof(uint8_t));
+        if (!scratch) return;
+        for (int row = 0; row < y1; row++) {
+            region_row(sparse, row, 0, x1, scratch + (int64_t)row * x1);
+        }
+        unpredict(sparse->predictor, scratch, y1, x1, x1, 1);
+        for (int row = y0; row < y1; row++) {
+            memcpy(dense + (int64_t)(row - y) * width + (x0 - x), scratch + (int64_t)row * x1 + x0, x1 - x0);
+        }
+        free(scratch);
+        return;
+    }
+    
+    for (int row = y0; row < y1; row++) {
+        uint8_t* out = dense + (int64_t)(row - y) * width + (x0 - x);
+        region_row(sparse, row, x0, x1, out);
+    }
+}
+
+void sparse_iterator_init(SparseIterator* it, SparseMatrix* sparse) {
+    memset(it, 0, sizeof(*it));
+    it->matrix = sparse;
+    // A matrix without pixels has no bitmap words
+    if (sparse->format == SPARSE_FORMAT_BITMAP && sparse->bitmap) {
+        it->word = sparse->bitmap[0];
+    }
+}
+
+// Fetch the next non-zero; returns 0 once every element has been visited
+int sparse_iterator_next(SparseIterator* it, int* row, int* col, uint8_t* value) {
+    SparseMatrix* sparse = it->matrix;
+    
+    switch (sparse->format) {
+    case SPARSE_FORMAT_DENSE: {
+        int64_t n = (int64_t)sparse->rows * sparse->cols;
+        while (it->pixel < n && value_at(sparse, it->pixel) == 0) {
+            it->pixel++;
+        }
+        if (it->pixel >= n) return 0;
+        *row = (int)(it->pixel / sparse->cols);
+        *col = (int)(it->pixel % sparse->cols);
+        *value = value_at(sparse, it->pixel++);
+        return 1;
+    }
+    case SPARSE_FORMAT_CSR:
+        if (it->index >= sparse->size) return 0;
+        while (row_start(sparse, it->row + 1) <= it->index) {
+            it->row++;
+        }
+        *row = it->row;
+        *col = sparse->col_idx[it->index];
+        *value = value_at(sparse, it->index++);
+        return 1;
+    case SPARSE_FORMAT_RLE:
+        if (it->index >= sparse->size) return 0;
+        while (it->run_pos >= sparse->run_len[it->run]) {
+            it->run++;
+            it->run_pos = 0;
+        }
+        while (row_start(sparse, it->row + 1) <= it->run) {
+            it->row++;
+        }
+        *row = it->row;
+        *col = sparse->col_idx[it->run] + it->run_pos++;
+        *value = value_at(sparse, it->index++);
+        return 1;
+    case SPARSE_FORMAT_BITMAP: {
+        int64_t words = bitmap_word_count(sparse->rows, sparse->cols);
+        while (it->word == 0) {
+            if (++it->word_index >= words) return 0;
+            it->word = sparse->bitmap[it->word_index];
+        }
+        int64_t idx = it->word_index * 64 + __builtin_ctzll(it->word);
+        it->word &= it->word - 1;
+        *row = (int)(idx / sparse->cols);
+        *col = (int)(idx % sparse->cols);
+        *value = value_at(sparse, it->index++);
+        return 1;
+    }
+    default:
+        if (it->index >= sparse->size) return 0;
+        *row = sparse->row_idx[it->index];
+        *col = sparse->col_idx[it->index];
+        *value = value_at(sparse, it->index++);
+        return 1;
     }
 }
 
+// Re-encode a matrix in another layout without going through a dense
+// plane. The source must be in row-major order; it is left untouched.
+SparseMatrix* sparse_matrix_convert(SparseMatrix* sparse, SparseFormat format) {
+    SparseIterator it;
+    int row, col;
+    uint8_t value;
+    
+    // Runs are only needed to size RLE storage or to compare layouts
+    int64_t runs = 0;
+    if (format == SPARSE_FORMAT_RLE || format == SPARSE_FORMAT_AUTO) {
+        int prev_row = -1;
+        int prev_col = -1;
+        sparse_iterator_init(&it, sparse);
+        while (sparse_iterator_next(&it, &row, &col, &value)) {
+            runs += !(row == prev_row && col == prev_col + 1);
+            prev_row = row;
+            prev_col = col;
+        }
+    }
+    if (format == SPARSE_FORMAT_AUTO) {
+        format = smallest_format(sparse->rows, sparse->cols, sparse->size, runs, 0);
+    }
+    
+    SparseMatrix* out = sparse_matrix_create_with_capacity(sparse->rows, sparse->cols, sparse->threshold,
+                                                           format, sparse->size, runs, NULL);
+    if (!out) return NULL;
+    
+    int64_t k = 0;
+    int64_t r = 0;
+    int last_row = -1;
+    sparse_iterator_init(&it, sparse);
+    while (sparse_iterator_next(&it, &row, &col, &value)) {
+        switch (format) {
+        case SPARSE_FORMAT_DENSE:
+            out->values[(int64_t)row * out->cols + col] = value;
+            break;
+        case SPARSE_FORMAT_CSR:
+            // Count per row here, prefix-summed below
+            out->col_idx[k] = col;
+            out->row_ptr[row + 1]++;
+            break;
+        case SPARSE_FORMAT_RLE:
+            if (r > 0 && row == last_row && out->col_idx[r - 1] + out->run_len[r - 1] == col) {
+                out->run_len[r - 1]++;
+            } else {
+                out->col_idx[r] = col;
+                out->run_len[r] = 1;
+                out->row_ptr[row + 1]++;
+                r++;
+            }
+            out->value_ptr[row + 1]++;
+            last_row = row;
+            break;
+        case SPARSE_FORMAT_BITMAP: {
+            int64_t idx = (int64_t)row * out->cols + col;
+            out->bitmap[idx / 64] |= (uint64_t)1 << (idx % 64);
+            break;
+        }
+        default:
+            out->row_idx[k] = row;
+            out->col_idx[k] = col;
+            break;
+        }
+        if (format != SPARSE_FORMAT_DENSE) {
+            out->values[k] = value;
+        }
+        k++;
+    }
+    out->size = k;
+    out->num_runs = r;
+    
+    if (format == SPARSE_FORMAT_CSR || format == SPARSE_FORMAT_RLE) {
+        for (int i = 0; i < out->rows; i++) {
+            out->row_ptr[i + 1] += out->row_ptr[i];
+            if (out->value_ptr) out->value_ptr[i + 1] += out->value_ptr[i];
+        }
+    } else if (format == SPARSE_FORMAT_BITMAP) {
+        int64_t words = bitmap_word_count(out->rows, out->cols);
+        int64_t rank = 0;
+        for (int64_t w = 0; w < words; w++) {
+            if (w % BITMAP_RANK_WORDS == 0) {
+                out->bitmap_rank[w / BITMAP_RANK_WORDS] = rank;
+            }
+            rank += __builtin_popcountll(out->bitmap[w]);
+        }
+        out->bitmap_rank[bitmap_block_count(out->rows, out->cols)] = rank;
+    }
+    
+    // Same residuals in another layout
+    out->predictor = sparse->predictor;
+    return out;
+}
+
+// Runs of consecutive columns in CSR arrays
+static int64_t csr_run_count(int rows, const int64_t* row_ptr, const int* col_idx) {
+    int64_t runs = 0;
+    for (int i = 0; i < rows; i++) {
+        for (int64_t k = row_ptr[i]; k < row_ptr[i + 1]; k++) {
+            runs += k == row_ptr[i] || col_idx[k] != col_idx[k - 1] + 1;
+        }
+    }
+    return runs;
+}
+
+// Build a matrix from CSR arrays that hold row-major, above-threshold
+// values: row_ptr has rows + 1 offsets, col_idx and values row_ptr[rows]
+// entries, each heap-allocated with room for at least one. The arrays are
+// adopted (CSR, and RLE's run columns and values) or freed, also on failure.
+SparseMatrix* sparse_matrix_from_csr(int rows, int cols, uint8_t threshold, SparseFormat format,
+                                     int64_t* row_ptr, int* col_idx, uint8_t* values) {
+    int64_t nnz = row_ptr[rows];
+    int64_t runs = 0;
+    if (format == SPARSE_FORMAT_RLE || format == SPARSE_FORMAT_AUTO) {
+        runs = csr_run_count(rows, row_ptr, col_idx);
+    }
+    if (format == SPARSE_FORMAT_AUTO) {
+        format = smallest_format(rows, cols, nnz, runs, 0);
+    }
+    
+    if (format == SPARSE_FORMAT_BITMAP || format == SPARSE_FORMAT_DENSE) {
+        // No arrays to share: place each value in a fresh matrix
+        SparseMatrix* out = sparse_matrix_create_with_capacity(rows, cols, threshold, format, nnz, 0, NULL);
+        if (out) {
+            for (int i = 0; i < rows; i++) {
+                for (int64_t k = row_ptr[i]; k < row_ptr[i + 1]; k++) {
+                    int64_t idx = (int64_t)i * cols + col_idx[k];
+                    if (format == SPARSE_FORMAT_DENSE) {
+                        out->values[idx] = values[k];
+                    } else {
+                        out->bitmap[idx / 64] |= (uint64_t)1 << (idx % 64);
+                        out->values[k] = values[k];
+                    }
+                }
+            }
+            if (format == SPARSE_FORMAT_BITMAP) {
+                int64_t words = bitmap_word_count(rows, cols);
+                int64_t rank = 0;
+                for (int64_t w = 0; w < words; w++) {
+                    if (w % BITMAP_RANK_WORDS == 0) {
+                        out->bitmap_rank[w / BITMAP_RANK_WORDS] = rank;
+                    }
+                    rank += __builtin_popcountll(out->bitmap[w]);
+                }
+                out->bitmap_rank[bitmap_block_count(rows, cols)] = rank;
+            }
+            out->size = nnz;
+        }
+        free(row_ptr);
+        free(col_idx);
+        free(values);
+        return out;
+    }
+    
+    SparseMatrix* out = (SparseMatrix*)calloc(1, sizeof(SparseMatrix));
+    int* run_len = format == SPARSE_FORMAT_RLE ? (int*)malloc(sizeof(int) * (size_t)(runs > 0 ? runs : 1)) : NULL;
+    int64_t* run_ptr = format == SPARSE_FORMAT_RLE ? (int64_t*)calloc((size_t)rows + 1, sizeof(int64_t)) : NULL;
+    int* row_idx = format == SPARSE_FORMAT_COO ? (int*)malloc(sizeof(int) * (size_t)(nnz > 0 ? nnz : 1)) : NULL;
+    if (!out || (format == SPARSE_FORMAT_RLE && (!run_len || !run_ptr)) || (format == SPARSE_FORMAT_COO && !row_idx)) {
+        free(out);
+        free(run_len);
+        free(run_ptr);
+        free(row_idx);
+        free(row_ptr);
+        free(col_idx);
+        free(values);
+        return NULL;
+    }
+    
+    out->format = format;
+    out->rows = rows;
+    out->cols = cols;
+    out->threshold = threshold;
+    out->size = nnz;
+    out->capacity = nnz > 0 ? nnz : 1;
+    out->last_row = rows;
+    out->col_idx = col_idx;
+    out->values = values;
+    
+    if (format == SPARSE_FORMAT_COO) {
+        for (int i = 0; i < rows; i++) {
+            for (int64_t k = row_ptr[i]; k < row_ptr[i + 1]; k++) {
+                row_idx[k] = i;
+            }
+        }
+        out->row_idx = row_idx;
+        free(row_ptr);
+    } else if (format == SPARSE_FORMAT_RLE) {
+        // Runs are written over the columns they start from, never ahead
+        // of the element being read. The CSR offsets become value offsets.
+        int64_t r = 0;
+        for (int i = 0; i < rows; i++) {
+            for (int64_t k = row_ptr[i]; k < row_ptr[i + 1]; k++) {
+                if (k > row_ptr[i] && col_idx[k] == col_idx[k - 1] + 1) {
+                    run_len[r - 1]++;
+                } else {
+                    col_idx[r] = col_idx[k];
+                    run_len[r++] = 1;
+                }
+            }
+            run_ptr[i + 1] = r;
+        }
+        out->row_ptr = run_ptr;
+        out->value_ptr = row_ptr;
+        out->run_len = run_len;
+        out->num_runs = runs;
+        out->run_capacity = runs > 0 ? runs : 1;
+        int* shrunk = (int*)realloc(col_idx, sizeof(int) * (size_t)out->run_capacity);
+        if (shrunk) out->col_idx = shrunk;
+    } else {
+        out->row_ptr = row_ptr;
+    }
+    return out;
+}
+
+// COO: the scan kernel picks the survivors of each chunk of values and
+// their coordinates move down with them
+static void raise_threshold_coo(SparseMatrix* sparse, uint8_t threshold) {
+    int idx[FILTER_CHUNK];
+    int64_t k = 0;
+    
+    for (int64_t base = 0; base < sparse->size; base += FILTER_CHUNK) {
+        int len = sparse->size - base < FILTER_CHUNK ? (int)(sparse->size - base) : FILTER_CHUNK;
+        int count = sparse_scan_above(sparse->values + base, len, threshold, idx);
+        for (int m = 0; m < count; m++) {
+            int64_t src = base + idx[m];
+            sparse->row_idx[k] = sparse->row_idx[src];
+            sparse->col_idx[k] = sparse->col_idx[src];
+            sparse->values[k] = sparse->values[src];
+            k++;
+        }
+    }
+    
+    sparse->size = k;
+}
+
+// CSR: filter row by row so each row pointer can be rewritten as soon as
+// its row is done
+static int raise_threshold_csr(SparseMatrix* sparse, uint8_t threshold) {
+    int* idx = (int*)malloc(sizeof(int) * (sparse->cols > 0 ? sparse->cols : 1));
+    if (!idx) return 0;
+    
+    int64_t k = 0;
+    int64_t begin = sparse->row_ptr[0];
+    for (int i = 0; i < sparse->rows; i++) {
+        int64_t end = sparse->row_ptr[i + 1];
+        int count = sparse_scan_above(sparse->values + begin, (int)(end - begin), threshold, idx);
+        for (int m = 0; m < count; m++) {
+            sparse->col_idx[k] = sparse->col_idx[begin + idx[m]];
+            sparse->values[k] = sparse->values[begin + idx[m]];
+            k++;
+        }
+        sparse->row_ptr[i + 1] = k;
+        begin = end;
+    }
+    
+    free(idx);
+    sparse->size = k;
+    return 1;
+}
+
+// RLE: dropping pixels inside a run splits it, so the run count can grow.
+// Pass 1 counts the new runs to size fresh run arrays; pass 2 fills them
+// while the values compact in place.
+static int raise_threshold_rle(SparseMatrix* sparse, uint8_t threshold) {
+    int64_t runs = 0;
+    int64_t offset = 0;
+    for (int64_t r = 0; r < sparse->num_runs; r++) {
+        runs += sparse_count_runs_above(sparse->values + offset, sparse->run_len[r], threshold);
+        offset += sparse->run_len[r];
+    }
+    
+    int64_t capacity = runs > 0 ? runs : 1;
+    int* col_idx = (int*)matrix_alloc(sparse->arena, sizeof(int) * (size_t)capacity);
+    int* run_len = (int*)matrix_alloc(sparse->arena, sizeof(int) * (size_t)capacity);
+    int* idx = (int*)malloc(sizeof(int) * (sparse->cols > 0 ? sparse->cols : 1));
+    if (!col_idx || !run_len || !idx) {
+        matrix_release(sparse->arena, col_idx);
+        matrix_release(sparse->arena, run_len);
+        free(idx);
+        return 0;
+    }
+    
+    int64_t k = 0;
+    int64_t out = 0;
+    int64_t r = 0;
+    offset = 0;
+    for (int i = 0; i < sparse->rows; i++) {
+        for (; r < sparse->row_ptr[i + 1]; r++) {
+            int len = sparse->run_len[r];
+            int count = sparse_scan_above(sparse->values + offset, len, threshold, idx);
+            int m = 0;
+            while (m < count) {
+                int start = idx[m];
+                int span = 1;
+                while (m + span < count && idx[m + span] == start + span) {
+                    span++;
+                }
+                col_idx[out] = sparse->col_idx[r] + start;
+                run_len[out] = span;
+                memmove(sparse->values + k, sparse->values + offset + start, span);
+                out++;
+                k += span;
+                m += span;
+            }
+            offset += len;
+        }
+        sparse->row_ptr[i + 1] = out;
+        sparse->value_ptr[i + 1] = k;
+    }
+    
+    free(idx);
+    matrix_release(sparse->arena, sparse->col_idx);
+    matrix_release(sparse->arena, sparse->run_len);
+    sparse->col_idx = col_idx;
+    sparse->run_len = run_len;
+    sparse->run_capacity = capacity;
+    sparse->num_runs = out;
+    sparse->size = k;
+    return 1;
+}
+
+// BITMAP: clear the bit of every dropped value and rebuild the ranks in the
+// same walk. Survivors are written unconditionally and the cursor advances
+// only past kept ones, so the walk has no data-dependent branches.
+static void raise_threshold_bitmap(SparseMatrix* sparse, uint8_t threshold) {
+    int64_t words = bitmap_word_count(sparse->rows, sparse->cols);
+    int64_t src = 0;
+    int64_t k = 0;
+    
+    for (int64_t w = 0; w < words; w++) {
+        if (w % BITMAP_RANK_WORDS == 0) {
+            sparse->bitmap_rank[w / BITMAP_RANK_WORDS] = k;
+        }
+        uint64_t word = sparse->bitmap[w];
+        uint64_t keep = word;
+        while (word) {
+            uint64_t bit = word & (~word + 1);
+            uint8_t value = sparse->values[src++];
+            int dropped = value <= threshold;
+            sparse->values[k] = value;
+            k += !dropped;
+            keep &= ~(bit & (0 - (uint64_t)dropped));
+            word &= word - 1;
+        }
+        sparse->bitmap[w] = keep;
+    }
+    
+    sparse->bitmap_rank[bitmap_block_count(sparse->rows, sparse->cols)] = k;
+    sparse->size = k;
+}
+
+// DENSE: zero the pixels that no longer pass
+static void raise_threshold_dense(SparseMatrix* sparse, uint8_t threshold) {
+    int64_t n = (int64_t)sparse->rows * sparse->cols;
+    int64_t nnz = 0;
+    
+    for (int64_t i = 0; i < n; i++) {
+        uint8_t value = sparse->values[i] > threshold ? sparse->values[i] : 0;
+        sparse->values[i] = value;
+        nnz += value != 0;
+    }
+    sparse->size = nnz;
+}
+
+// Raise the threshold of an existing matrix, dropping every non-zero at or
+// below it. The survivors are compacted in place without the dense source,
+// so the work is linear in nnz (in the plane or bitmap size for DENSE and
+// BITMAP). Passing the current threshold re-applies it, e.g. after values
+// were edited; a lower one leaves the matrix as it is. Returns 1 on
+// success, 0 for borrowed, quantized or predicted matrices or if memory ran
+// out.
+int sparse_matrix_raise_threshold(SparseMatrix* sparse, uint8_t threshold) {
+    if (sparse->borrowed || sparse->quantized || sparse->predictor != SPARSE_PREDICT_NONE) return 0;
+    if (threshold < sparse->threshold) return 1;
+    
+    switch (sparse->format) {
+    case SPARSE_FORMAT_DENSE:
+        raise_threshold_dense(sparse, threshold);
+        break;
+    case SPARSE_FORMAT_CSR:
+        close_rows(sparse);
+        if (!raise_threshold_csr(sparse, threshold)) return 0;
+        break;
+    case SPARSE_FORMAT_RLE:
+        close_rows(sparse);
+        if (!raise_threshold_rle(sparse, threshold)) return 0;
+        break;
+    case SPARSE_FORMAT_BITMAP:
+        raise_threshold_bitmap(sparse, threshold);
+        break;
+    default:
+        raise_threshold_coo(sparse, threshold);
+        break;
+    }
+    
+    sparse->threshold = threshold;
+    return 1;
+}
+
 float sparse_matrix_compression_ratio(SparseMatrix* sparse) {
-    int dense_size = dense_matrix_get_size_bytes(sparse->rows, sparse->cols);
-    int sparse_size = sparse_matrix_get_size_bytes(sparse);
+    size_t dense_size = dense_matrix_get_size_bytes(sparse->rows, sparse->cols);
+    size_t sparse_size = sparse_matrix_get_size_bytes(sparse);
     
     if (sparse_size == 0) return 0.0f;
-    return (float)dense_size / sparse_size;
+    return (float)dense_size / (float)sparse_size;
 }
 
-int sparse_matrix_get_size_bytes(SparseMatrix* sparse) {
-    return sizeof(SparseMatrix) + (sparse->size * sizeof(SparseNode));
+size_t sparse_matrix_get_size_bytes(SparseMatrix* sparse) {
+    return sparse_format_size_bytes(sparse->format, sparse->rows, sparse->cols, sparse->size, sparse->num_runs,
+                                    sparse->quantized);
 }
 
-int dense_matrix_get_size_bytes(int rows, int cols) {
-    return rows * cols * sizeof(uint8_t);
+size_t dense_matrix_get_size_bytes(int rows, int cols) {
+    return (size_t)rows * cols * sizeof(uint8_t);
 }
 
+// Bytes of the layout SPARSE_FORMAT_AUTO would pick for a plane with this
+// many non-zeros and runs, without building it
+size_t sparse_matrix_estimate_size_bytes(int rows, int cols, int64_t nnz, int64_t runs) {
+    return sparse_format_size_bytes(smallest_format(rows, cols, nnz, runs, 0), rows, cols, nnz, runs, 0);
+}
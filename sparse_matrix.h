@@ -1,35 +1,115 @@
 #ifndef SPARSE_MATRIX_H
 #define SPARSE_MATRIX_H
 
+#include "arena.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 
-// Node structure for sparse matrix (COO format - Coordinate format)
-typedef struct {
-    int row;
-    int col;
-    uint8_t value;
-} SparseNode;
+#define BITMAP_RANK_WORDS 8  // Bitmap words (512 pixels) per rank directory entry
+
+// Storage layout of a sparse matrix
+typedef enum {
+    SPARSE_FORMAT_COO,    // Coordinate list: one (row, col, value) node per non-zero
+    SPARSE_FORMAT_CSR,    // Compressed sparse row: row pointers + column indices + values
+    SPARSE_FORMAT_RLE,    // Run-length: per-row runs of consecutive non-zeros + packed values
+    SPARSE_FORMAT_BITMAP, // One occupancy bit per pixel + packed values
+    SPARSE_FORMAT_DENSE,  // Plain plane with below-threshold pixels zeroed
+    SPARSE_FORMAT_AUTO    // Conversion only: pick the smallest of the above by density
+} SparseFormat;
+
+// Prediction applied before thresholding (the PNG filter types). A predicted
+// matrix stores the zigzag-coded difference between each pixel and its
+// prediction from already decoded neighbours, so smooth areas become zero.
+typedef enum {
+    SPARSE_PREDICT_NONE,    // Values are stored as-is
+    SPARSE_PREDICT_LEFT,    // Pixel to the left
+    SPARSE_PREDICT_UP,      // Pixel above
+    SPARSE_PREDICT_AVERAGE, // Mean of left and above, rounded down
+    SPARSE_PREDICT_PAETH    // Whichever of left, above, upper-left is closest to left + above - upper-left
+} SparsePredictor;
 
 // Sparse matrix structure
 typedef struct {
-    SparseNode* data;
-    int size;          // Number of non-zero elements
-    int capacity;      // Allocated capacity
-    int rows;          // Original matrix rows
-    int cols;          // Original matrix cols
-    uint8_t threshold; // Threshold below which values are considered zero
+    SparseFormat format;
+    // Non-zeros are kept as parallel arrays (structure of arrays) rather
+    // than padded (row, col, value) structs. Rows and columns fit in an
+    // int; counts and offsets are 64-bit so planes can pass 2^31 pixels.
+    int* row_idx;          // COO row index of each non-zero
+    int64_t* row_ptr;      // CSR: rows + 1 offsets into col_idx/values; RLE: into runs
+    int64_t* value_ptr;    // RLE: rows + 1 offsets into values
+    int* col_idx;          // Column index of each non-zero (RLE: start column of each run)
+    uint8_t* values;       // Value of each non-zero (DENSE: the whole plane)
+    int* run_len;          // RLE: number of pixels in each run
+    int64_t num_runs;      // RLE: number of runs
+    int64_t run_capacity;  // RLE: allocated runs
+    int last_row;          // CSR/RLE: row_ptr is written up to this entry; later rows are empty so far
+    uint64_t* bitmap;      // BITMAP: occupancy bit per pixel, row-major, 64 per word
+    int64_t* bitmap_rank;  // BITMAP: number of values before each block of words
+    int64_t size;          // Number of non-zero elements
+    int64_t capacity;      // Allocated capacity
+    int rows;              // Original matrix rows
+    int cols;              // Original matrix cols
+    uint8_t threshold;     // Threshold below which values are considered zero
+    int borrowed;          // Arrays live in memory owned elsewhere (e.g. a file mapping); read-only
+    int quantized;         // Values are 4-bit levels packed two per byte, low nibble first
+    SparsePredictor predictor; // Values are prediction residuals rather than pixels
+    Arena* arena;          // Owner of the struct and arrays, NULL when they are on the heap
 } SparseMatrix;
 
+// Cursor over the non-zeros of a matrix in row-major order, whatever its
+// layout. For predicted matrices these are the stored residuals.
+typedef struct {
+    SparseMatrix* matrix;
+    int64_t index;         // Next value to return
+    int row;               // Current row (CSR, RLE)
+    int64_t run;           // Current run (RLE)
+    int run_pos;           // Pixels of the current run already returned (RLE)
+    int64_t pixel;         // Next pixel to examine (DENSE)
+    int64_t word_index;    // Current bitmap word (BITMAP)
+    uint64_t word;         // Bits of the current word not yet returned (BITMAP)
+} SparseIterator;
+
+// Writes row y of each of `channels` planes to planes, channel c at
+// planes + c * cols. Called from worker threads, each with its own buffer.
+typedef void (*SparseRowSource)(void* ctx, int y, uint8_t* planes);
+
 // Function declarations
 SparseMatrix* sparse_matrix_create(int rows, int cols, uint8_t threshold);
+SparseMatrix* sparse_matrix_create_format(int rows, int cols, uint8_t threshold, SparseFormat format);
+SparseMatrix* sparse_matrix_create_arena(int rows, int cols, uint8_t threshold, SparseFormat format, Arena* arena);
 void sparse_matrix_free(SparseMatrix* matrix);
-void sparse_matrix_add(SparseMatrix* matrix, int row, int col, uint8_t value);
+int sparse_matrix_add(SparseMatrix* matrix, int row, int col, uint8_t value);
 SparseMatrix* sparse_matrix_from_dense(uint8_t* dense, int rows, int cols, uint8_t threshold);
+SparseMatrix* sparse_matrix_from_dense_format(uint8_t* dense, int rows, int cols, uint8_t threshold, SparseFormat format);
+SparseMatrix* sparse_matrix_from_dense_arena(uint8_t* dense, int rows, int cols, uint8_t threshold,
+                                             SparseFormat format, Arena* arena);
+SparseMatrix* sparse_matrix_from_dense_quantized(uint8_t* dense, int rows, int cols, uint8_t threshold,
+                                                 SparseFormat format);
+SparseMatrix* sparse_matrix_from_dense_predicted(uint8_t* dense, int rows, int cols, uint8_t threshold,
+                                                 SparseFormat format, SparsePredictor predictor);
+int sparse_matrices_from_interleaved(const uint8_t* pixels, int rows, int cols, int channels,
+                                     uint8_t threshold, SparseFormat format, SparseMatrix** out);
+int sparse_matrices_from_interleaved_arena(const uint8_t* pixels, int rows, int cols, int channels,
+                                           uint8_t threshold, SparseFormat format, SparseMatrix** out,
+                                           Arena* arena);
+int sparse_matrices_from_rows(SparseRowSource source, void* ctx, int rows, int cols, int channels,
+                              uint8_t threshold, SparseFormat format, SparseMatrix** out);
 void sparse_matrix_to_dense(SparseMatrix* sparse, uint8_t* dense);
+void sparse_matrix_scatter(SparseMatrix* sparse, uint8_t* dense, int stride);
+void sparse_matrix_to_dense_region(SparseMatrix* sparse, int x, int y, int width, int height, uint8_t* dense);
+uint8_t sparse_matrix_get(SparseMatrix* sparse, int row, int col);
+SparseFormat sparse_matrix_choose_format(uint8_t* dense, int rows, int cols, uint8_t threshold);
+SparseMatrix* sparse_matrix_convert(SparseMatrix* sparse, SparseFormat format);
+SparseMatrix* sparse_matrix_from_csr(int rows, int cols, uint8_t threshold, SparseFormat format,
+                                     int64_t* row_ptr, int* col_idx, uint8_t* values);
+int sparse_matrix_raise_threshold(SparseMatrix* sparse, uint8_t threshold);
+void sparse_iterator_init(SparseIterator* it, SparseMatrix* sparse);
+int sparse_iterator_next(SparseIterator* it, int* row, int* col, uint8_t* value);
 float sparse_matrix_compression_ratio(SparseMatrix* sparse);
-int sparse_matrix_get_size_bytes(SparseMatrix* sparse);
-int dense_matrix_get_size_bytes(int rows, int cols);
+size_t sparse_matrix_get_size_bytes(SparseMatrix* sparse);
+size_t dense_matrix_get_size_bytes(int rows, int cols);
+size_t sparse_matrix_estimate_size_bytes(int rows, int cols, int64_t nnz, int64_t runs);
 
 #endif // SPARSE_MATRIX_H
 
@@ -0,0 +1,149 @@
+#include "sparse_ops.h"
+#include <math.h>
+
+typedef enum {
+    SPARSE_OP_ADD,
+    SPARSE_OP_SUBTRACT,
+    SPARSE_OP_MASK
+} SparseOp;
+
+static uint8_t clamp_u8(float v) {
+    if (v < 0.0f) return 0;
+    if (v > 255.0f) return 255;
+    return (uint8_t)(v + 0.5f);
+}
+
+void sparse_ops_lut_brightness(uint8_t* lut, int delta) {
+    for (int v = 0; v < 256; v++) {
+        lut[v] = clamp_u8((float)(v + delta));
+    }
+}
+
+// Stretch values away from (factor > 1) or towards (factor < 1) mid-grey
+void sparse_ops_lut_contrast(uint8_t* lut, float factor) {
+    for (int v = 0; v < 256; v++) {
+        lut[v] = clamp_u8((v - 128.0f) * factor + 128.0f);
+    }
+}
+
+void sparse_ops_lut_gamma(uint8_t* lut, float gamma) {
+    for (int v = 0; v < 256; v++) {
+        lut[v] = clamp_u8(255.0f * powf(v / 255.0f, gamma));
+    }
+}
+
+int sparse_ops_apply_lut(SparseMatrix* sparse, const uint8_t* lut) {
+    if (sparse->borrowed || sparse->quantized || sparse->predictor != SPARSE_PREDICT_NONE) return 0;
+    
+    if (sparse->format == SPARSE_FORMAT_DENSE) {
+        // The plane holds every pixel; the zero ones are not stored values
+        int64_t n = (int64_t)sparse->rows * sparse->cols;
+        for (int64_t i = 0; i < n; i++) {
+            uint8_t v = sparse->values[i];
+            sparse->values[i] = v ? lut[v] : 0;
+        }
+    } else {
+        for (int64_t i = 0; i < sparse->size; i++) {
+            sparse->values[i] = lut[sparse->values[i]];
+        }
+    }
+    
+    // Drop whatever the map pushed to or below the threshold
+    return sparse_matrix_raise_threshold(sparse, sparse->threshold);
+}
+
+int sparse_ops_scale(SparseMatrix* sparse, float factor) {
+    uint8_t lut[256];
+    for (int v = 0; v < 256; v++) {
+        lut[v] = clamp_u8(v * factor);
+    }
+    return sparse_ops_apply_lut(sparse, lut);
+}
+
+// Next non-zero of it as a linear pixel index
+static int next_linear(SparseIterator* it, int64_t* idx, uint8_t* value) {
+    int row, col;
+    if (!sparse_iterator_next(it, &row, &col, value)) return 0;
+    *idx = (int64_t)row * it->matrix->cols + col;
+    return 1;
+}
+
+// Merge the non-zeros of a and b in row-major order into CSR arrays sized
+// for the largest possible result, then build a's layout from them
+static SparseMatrix* sparse_ops_combine(SparseMatrix* a, SparseMatrix* b, SparseOp op) {
+    if (!a || !b || a->rows != b->rows || a->cols != b->cols) return NULL;
+    if (a->predictor != SPARSE_PREDICT_NONE || b->predictor != SPARSE_PREDICT_NONE) return NULL;
+    
+    // Only addition keeps pixels that are zero in a
+    int64_t bound = op == SPARSE_OP_ADD ? a->size + b->size : a->size;
+    if (bound > (int64_t)a->rows * a->cols) bound = (int64_t)a->rows * a->cols;
+    int64_t* row_ptr = (int64_t*)calloc((size_t)a->rows + 1, sizeof(int64_t));
+    int* col_idx = (int*)malloc(sizeof(int) * (size_t)(bound > 0 ? bound : 1));
+    uint8_t* values = (uint8_t*)malloc((size_t)(bound > 0 ? bound : 1));
+    if (!row_ptr || !col_idx || !values) {
+        free(row_ptr);
+        free(col_idx);
+        free(values);
+        return NULL;
+    }
+    
+    SparseIterator ia, ib;
+    int64_t pa = 0, pb = 0;
+    uint8_t va = 0, vb = 0;
+    sparse_iterator_init(&ia, a);
+    sparse_iterator_init(&ib, b);
+    int has_a = next_linear(&ia, &pa, &va);
+    int has_b = next_linear(&ib, &pb, &vb);
+    int64_t k = 0;
+    
+    while (has_a || has_b) {
+        int64_t idx;
+        int value;
+        if (has_a && (!has_b || pa < pb)) {
+            // Only in a: b is zero here
+            idx = pa;
+            value = op == SPARSE_OP_MASK ? 0 : va;
+            has_a = next_linear(&ia, &pa, &va);
+        } else if (!has_a || pb < pa) {
+            // Only in b: a is zero here
+            idx = pb;
+            value = op == SPARSE_OP_ADD ? vb : 0;
+            has_b = next_linear(&ib, &pb, &vb);
+        } else {
+            idx = pa;
+            if (op == SPARSE_OP_ADD) {
+                value = va + vb > 255 ? 255 : va + vb;
+            } else if (op == SPARSE_OP_SUBTRACT) {
+                value = va > vb ? va - vb : 0;
+            } else {
+                value = va;
+            }
+            has_a = next_linear(&ia, &pa, &va);
+            has_b = next_linear(&ib, &pb, &vb);
+        }
+        
+        // Row counts here, prefix-summed below
+        if (value > a->threshold) {
+            row_ptr[idx / a->cols + 1]++;
+            col_idx[k] = (int)(idx % a->cols);
+            values[k++] = (uint8_t)value;
+        }
+    }
+    
+    for (int i = 0; i < a->rows; i++) {
+        row_ptr[i + 1] += row_ptr[i];
+    }
+    return sparse_matrix_from_csr(a->rows, a->cols, a->threshold, a->format, row_ptr, col_idx, values);
+}
+
+SparseMatrix* sparse_ops_add(SparseMatrix* a, SparseMatrix* b) {
+    return sparse_ops_combine(a, b, SPARSE_OP_ADD);
+}
+
+SparseMatrix* sparse_ops_subtract(SparseMatrix* a, SparseMatrix* b) {
+    return sparse_ops_combine(a, b, SPARSE_OP_SUBTRACT);
+}
+
+SparseMatrix* sparse_ops_mask(SparseMatrix* a, SparseMatrix* mask) {
+    return sparse_ops_combine(a, mask, SPARSE_OP_MASK);
+}
@@ -0,0 +1,30 @@
+#ifndef SPARSE_OPS_H
+#define SPARSE_OPS_H
+
+#include "sparse_matrix.h"
+#include <stdint.h>
+
+// Pixel operations carried out on the stored non-zeros only, in O(nnz)
+// rather than over the whole plane. Pixels that are not stored count as
+// zero and stay zero under value maps; any result at or below the matrix
+// threshold is dropped from the matrix.
+
+// Lookup tables for sparse_ops_apply_lut()
+void sparse_ops_lut_brightness(uint8_t* lut, int delta);
+void sparse_ops_lut_contrast(uint8_t* lut, float factor);
+void sparse_ops_lut_gamma(uint8_t* lut, float gamma);
+
+// In-place value maps. Return 1 on success, 0 for borrowed, quantized or
+// predicted matrices or if memory ran out.
+int sparse_ops_apply_lut(SparseMatrix* sparse, const uint8_t* lut);
+int sparse_ops_scale(SparseMatrix* sparse, float factor);
+
+// Per-pixel combinations of two matrices of the same size, built by merging
+// their non-zeros in row-major order. The result is a new heap matrix in
+// a's layout with a's threshold, or NULL on size mismatch, predicted
+// inputs or allocation failure.
+SparseMatrix* sparse_ops_add(SparseMatrix* a, SparseMatrix* b);      // Saturating a + b
+SparseMatrix* sparse_ops_subtract(SparseMatrix* a, SparseMatrix* b); // a - b, clamped at zero
+SparseMatrix* sparse_ops_mask(SparseMatrix* a, SparseMatrix* mask);  // a where mask is non-zero
+
+#endif // SPARSE_OPS_H
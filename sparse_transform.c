@@ -0,0 +1,180 @@
+#include "sparse_transform.h"
+#include <stdlib.h>
+
+typedef enum {
+    REMAP_IDENTITY,
+    REMAP_TRANSPOSE,
+    REMAP_ROTATE_90,
+    REMAP_ROTATE_180,
+    REMAP_ROTATE_270,
+    REMAP_FLIP_HORIZONTAL,
+    REMAP_FLIP_VERTICAL,
+    REMAP_CROP
+} RemapKind;
+
+// Where each source pixel goes. `reversed` is set when elements that share
+// an output row arrive (in source row-major order) with decreasing columns.
+typedef struct {
+    RemapKind kind;
+    int rows;     // Source rows
+    int cols;     // Source cols
+    int out_rows;
+    int out_cols;
+    int x;        // Crop origin
+    int y;
+    int reversed;
+} Remap;
+
+// New position of (row, col); returns 0 if the pixel falls outside the result
+static int remap_pixel(const Remap* m, int row, int col, int* out_row, int* out_col) {
+    switch (m->kind) {
+    case REMAP_TRANSPOSE:
+        *out_row = col;
+        *out_col = row;
+        return 1;
+    case REMAP_ROTATE_90:
+        *out_row = col;
+        *out_col = m->rows - 1 - row;
+        return 1;
+    case REMAP_ROTATE_180:
+        *out_row = m->rows - 1 - row;
+        *out_col = m->cols - 1 - col;
+        return 1;
+    case REMAP_ROTATE_270:
+        *out_row = m->cols - 1 - col;
+        *out_col = row;
+        return 1;
+    case REMAP_FLIP_HORIZONTAL:
+        *out_row = row;
+        *out_col = m->cols - 1 - col;
+        return 1;
+    case REMAP_FLIP_VERTICAL:
+        *out_row = m->rows - 1 - row;
+        *out_col = col;
+        return 1;
+    case REMAP_CROP:
+        *out_row = row - m->y;
+        *out_col = col - m->x;
+        return *out_row >= 0 && *out_row < m->out_rows && *out_col >= 0 && *out_col < m->out_cols;
+    default:
+        *out_row = row;
+        *out_col = col;
+        return 1;
+    }
+}
+
+// Two passes over the source non-zeros: count per output row, then place
+// each element in its row's slice. Placing from the end of the slice when
+// the remap reverses columns keeps every row sorted without a comparison
+// sort. The sorted arrays are already CSR, so the result is built from them
+// directly in the source layout.
+static SparseMatrix* sparse_transform_apply(SparseMatrix* sparse, const Remap* m) {
+    // Residuals are tied to the scan order they were predicted in
+    if (sparse->predictor != SPARSE_PREDICT_NONE) return NULL;
+    
+    int64_t* row_ptr = (int64_t*)calloc((size_t)m->out_rows + 1, sizeof(int64_t));
+    if (!row_ptr) return NULL;
+    
+    SparseIterator it;
+    int row, col, out_row, out_col;
+    uint8_t value;
+    
+    sparse_iterator_init(&it, sparse);
+    while (sparse_iterator_next(&it, &row, &col, &value)) {
+        if (remap_pixel(m, row, col, &out_row, &out_col)) {
+            row_ptr[out_row + 1]++;
+        }
+    }
+    for (int i = 0; i < m->out_rows; i++) {
+        row_ptr[i + 1] += row_ptr[i];
+    }
+    
+    int64_t nnz = row_ptr[m->out_rows];
+    int64_t* cursor = (int64_t*)malloc(sizeof(int64_t) * ((size_t)m->out_rows + 1));
+    int* col_idx = (int*)malloc(sizeof(int) * (size_t)(nnz > 0 ? nnz : 1));
+    uint8_t* values = (uint8_t*)malloc((size_t)(nnz > 0 ? nnz : 1));
+    if (!cursor || !col_idx || !values) {
+        free(row_ptr);
+        free(cursor);
+        free(col_idx);
+        free(values);
+        return NULL;
+    }
+    
+    // Reversed rows fill from their end towards their start
+    for (int i = 0; i < m->out_rows; i++) {
+        cursor[i] = m->reversed ? row_ptr[i + 1] - 1 : row_ptr[i];
+    }
+    
+    sparse_iterator_init(&it, sparse);
+    while (sparse_iterator_next(&it, &row, &col, &value)) {
+        if (!remap_pixel(m, row, col, &out_row, &out_col)) continue;
+        int64_t k = m->reversed ? cursor[out_row]-- : cursor[out_row]++;
+        col_idx[k] = out_col;
+        values[k] = value;
+    }
+    
+    free(cursor);
+    
+    return sparse_matrix_from_csr(m->out_rows, m->out_cols, sparse->threshold, sparse->format,
+                                  row_ptr, col_idx, values);
+}
+
+static SparseMatrix* sparse_transform_simple(SparseMatrix* sparse, RemapKind kind) {
+    if (!sparse) return NULL;
+    
+    int swaps = kind == REMAP_TRANSPOSE || kind == REMAP_ROTATE_90 || kind == REMAP_ROTATE_270;
+    Remap m = { 0 };
+    m.kind = kind;
+    m.rows = sparse->rows;
+    m.cols = sparse->cols;
+    m.out_rows = swaps ? sparse->cols : sparse->rows;
+    m.out_cols = swaps ? sparse->rows : sparse->cols;
+    m.reversed = kind == REMAP_ROTATE_90 || kind == REMAP_ROTATE_180 || kind == REMAP_FLIP_HORIZONTAL;
+    
+    return sparse_transform_apply(sparse, &m);
+}
+
+SparseMatrix* sparse_transform_transpose(SparseMatrix* sparse) {
+    return sparse_transform_simple(sparse, REMAP_TRANSPOSE);
+}
+
+SparseMatrix* sparse_transform_rotate(SparseMatrix* sparse, int degrees) {
+    if (degrees % 90 != 0) return NULL;
+    
+    static const RemapKind turns[4] = {
+        REMAP_IDENTITY, REMAP_ROTATE_90, REMAP_ROTATE_180, REMAP_ROTATE_270
+    };
+    int quarter = ((degrees / 90) % 4 + 4) % 4;
+    return sparse_transform_simple(sparse, turns[quarter]);
+}
+
+SparseMatrix* sparse_transform_flip_horizontal(SparseMatrix* sparse) {
+    return sparse_transform_simple(sparse, REMAP_FLIP_HORIZONTAL);
+}
+
+SparseMatrix* sparse_transform_flip_vertical(SparseMatrix* sparse) {
+    return sparse_transform_simple(sparse, REMAP_FLIP_VERTICAL);
+}
+
+// The rectangle is clipped to the matrix; NULL if nothing of it remains
+SparseMatrix* sparse_transform_crop(SparseMatrix* sparse, int x, int y, int width, int height) {
+    if (!sparse || width <= 0 || height <= 0) return NULL;
+    
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int64_t x1 = (int64_t)x + width < sparse->cols ? (int64_t)x + width : sparse->cols;
+    int64_t y1 = (int64_t)y + height < sparse->rows ? (int64_t)y + height : sparse->rows;
+    if (x0 >= x1 || y0 >= y1) return NULL;
+    
+    Remap m = { 0 };
+    m.kind = REMAP_CROP;
+    m.rows = sparse->rows;
+    m.cols = sparse->cols;
+    m.x = x0;
+    m.y = y0;
+    m.out_rows = (int)(y1 - y0);
+    m.out_cols = (int)(x1 - x0);
+    
+    return sparse_transform_apply(sparse, &m);
+}
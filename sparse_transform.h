@@ -0,0 +1,17 @@
+#ifndef SPARSE_TRANSFORM_H
+#define SPARSE_TRANSFORM_H
+
+#include "sparse_matrix.h"
+
+// Geometric transforms computed on the non-zeros alone: every element's
+// coordinates are remapped and a counting sort on the new row restores
+// row-major order, so the dense plane is never built. Each returns a new
+// heap matrix in the source's layout and threshold, or NULL on failure or
+// for predicted matrices.
+SparseMatrix* sparse_transform_transpose(SparseMatrix* sparse);
+SparseMatrix* sparse_transform_rotate(SparseMatrix* sparse, int degrees); // Clockwise, a multiple of 90
+SparseMatrix* sparse_transform_flip_horizontal(SparseMatrix* sparse);
+SparseMatrix* sparse_transform_flip_vertical(SparseMatrix* sparse);
+SparseMatrix* sparse_transform_crop(SparseMatrix* sparse, int x, int y, int width, int height);
+
+#endif // SPARSE_TRANSFORM_H
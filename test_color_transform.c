@@ -0,0 +1,73 @@
+// Round-trip checks for the YCoCg-R path: `make test`
+#include "image_processor.h"
+#include <stdio.h>
+#include <string.h>
+
+// Black, the primaries, the secondaries and white, one per pixel
+static const uint8_t colors[8][3] = {
+    { 0, 0, 0 }, { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 },
+    { 255, 255, 0 }, { 0, 255, 255 }, { 255, 0, 255 }, { 255, 255, 255 }
+};
+
+static int round_trip(Image* img, uint8_t threshold, int subsample) {
+    YCoCgImage* ycocg = image_to_ycocg(img, threshold, subsample);
+    if (!ycocg) return 0;
+    
+    Image* back = ycocg_to_image(ycocg);
+    int ok = back && memcmp(back->data, img->data, (size_t)img->width * img->height * img->channels) == 0;
+    
+    ycocg_image_free(ycocg);
+    image_free(back);
+    return ok;
+}
+
+int main(void) {
+    int failed = 0;
+    
+    Image* img = image_create(8, 1, 3);
+    if (!img) return 1;
+    memcpy(img->data, colors, sizeof(colors));
+    
+    uint8_t thresholds[] = { 0, 8, 32 };
+    for (size_t i = 0; i < sizeof(thresholds); i++) {
+        if (!round_trip(img, thresholds[i], 0)) {
+            printf("FAIL: saturated colors at threshold %d\n", thresholds[i]);
+            failed = 1;
+        }
+    }
+    
+    // Every RGB triple survives the lossless setting
+    Image* all = image_create(4096, 4096, 3);
+    if (!all) return 1;
+    for (int i = 0; i < 4096 * 4096; i++) {
+        all->data[i * 3] = (uint8_t)i;
+        all->data[i * 3 + 1] = (uint8_t)(i >> 8);
+        all->data[i * 3 + 2] = (uint8_t)(i >> 16);
+    }
+    if (!round_trip(all, 0, 0)) {
+        printf("FAIL: lossless round trip\n");
+        failed = 1;
+    }
+    
+    // Flat 2x2 blocks survive subsampling, including the clipped blocks of
+    // an odd-sized image, and alpha is carried through
+    Image* blocks = image_create(5, 3, 4);
+    if (!blocks) return 1;
+    for (int y = 0; y < 3; y++) {
+        for (int x = 0; x < 5; x++) {
+            uint8_t* px = blocks->data + (y * 5 + x) * 4;
+            memcpy(px, colors[(y / 2 * 3 + x / 2) % 8], 3);
+            px[3] = (uint8_t)(x * 60);
+        }
+    }
+    if (!round_trip(blocks, 0, 1)) {
+        printf("FAIL: subsampled round trip\n");
+        failed = 1;
+    }
+    
+    image_free(img);
+    image_free(all);
+    image_free(blocks);
+    if (!failed) printf("color transform: all tests passed\n");
+    return failed;
+}
@@ -0,0 +1,99 @@
+// Canonical Huffman checks: `make test`
+#include "entropy_coder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Encode, check the mode byte and size, and decode back. expect_mode is
+// -1 when either mode will do.
+static int round_trip(const uint8_t* in, size_t n, int expect_mode, size_t max_size) {
+    uint8_t* coded = (uint8_t*)malloc(huffman_max_encoded_size(n));
+    uint8_t* out = (uint8_t*)malloc(n ? n : 1);
+    if (!coded || !out) {
+        free(coded);
+        free(out);
+        return 0;
+    }
+    
+    size_t len = huffman_encode(in, n, coded);
+    int ok = len <= huffman_max_encoded_size(n) && len <= max_size &&
+             (expect_mode < 0 || coded[0] == expect_mode) &&
+             huffman_decode(coded, len, out, n) && memcmp(in, out, n) == 0;
+    
+    // Every shortened coded block is refused
+    for (size_t cut = 0; ok && n > 0 && cut < len; cut += 1 + len / 16) {
+        ok = !huffman_decode(coded, cut, out, n);
+    }
+    
+    free(coded);
+    free(out);
+    return ok;
+}
+
+int main(void) {
+    int failed = 0;
+    
+    uint8_t empty = 0;
+    if (!round_trip(&empty, 0, 0, 1)) {
+        printf("FAIL: empty stream\n");
+        failed = 1;
+    }
+    
+    // One symbol costs a bit per byte plus the header
+    static uint8_t same[10000];
+    memset(same, 'a', sizeof(same));
+    if (!round_trip(same, sizeof(same), 1, 129 + sizeof(same) / 8 + 1)) {
+        printf("FAIL: single-symbol stream\n");
+        failed = 1;
+    }
+    
+    // Fibonacci frequencies give an unlimited Huffman tree one level per
+    // symbol, far past the 12-bit cap
+    size_t n = 0;
+    uint32_t a = 1, b = 1;
+    static uint8_t skewed[200000];
+    for (int s = 0; s < 24; s++) {
+        for (uint32_t i = 0; i < a && n < sizeof(skewed); i++) {
+            skewed[n++] = (uint8_t)s;
+        }
+        uint32_t next = a + b;
+        a = b;
+        b = next;
+    }
+    // Shuffle so the coder sees interleaved symbols
+    uint32_t seed = 99;
+    for (size_t i = n - 1; i > 0; i--) {
+        seed = seed * 1103515245 + 12345;
+        size_t j = (seed >> 8) % (i + 1);
+        uint8_t t = skewed[i];
+        skewed[i] = skewed[j];
+        skewed[j] = t;
+    }
+    if (!round_trip(skewed, n, 1, n / 2)) {
+        printf("FAIL: skewed stream with length-limited codes\n");
+        failed = 1;
+    }
+    
+    // Uniform bytes do not compress and are stored raw
+    static uint8_t noise[4096];
+    for (size_t i = 0; i < sizeof(noise); i++) {
+        seed = seed * 1103515245 + 12345;
+        noise[i] = (uint8_t)(seed >> 24);
+    }
+    if (!round_trip(noise, sizeof(noise), 0, sizeof(noise) + 1)) {
+        printf("FAIL: incompressible stream\n");
+        failed = 1;
+    }
+    
+    // Code lengths that over-subscribe the code space are refused
+    uint8_t bad[1 + 128 + 4] = { 1 };
+    memset(bad + 1, 0x11, 128);
+    uint8_t out[4];
+    if (huffman_decode(bad, sizeof(bad), out, sizeof(out))) {
+        printf("FAIL: over-subscribed code lengths accepted\n");
+        failed = 1;
+    }
+    
+    if (!failed) printf("entropy coder: all tests passed\n");
+    return failed;
+}
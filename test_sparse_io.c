@@ -0,0 +1,223 @@
+// .spm save/load checks: `make test`
+#include "sparse_io.h"
+#include <stdio.h>
+#include <string.h>
+
+#define ROWS 29
+#define COLS 67
+#define PATH "test_sparse_io.spm"
+#define CHANNELS 8
+
+// Runs, scattered pixels and a blank band, so each layout has work to do
+static void fill_plane(uint8_t* plane) {
+    uint32_t seed = 777;
+    for (int i = 0; i < ROWS * COLS; i++) {
+        seed = seed * 1103515245 + 12345;
+        int row = i / COLS;
+        int col = i % COLS;
+        if (row >= 10 && row < 14) {
+            plane[i] = 0;
+        } else if (col > 2 * row && col < 2 * row + 12) {
+            plane[i] = (uint8_t)(60 + row * 3);
+        } else {
+            plane[i] = (uint8_t)((seed >> 16) % 3 == 0 ? seed >> 24 : 0);
+        }
+    }
+}
+
+// One channel per layout and per kind of stored value
+static int make_channels(const uint8_t* plane, SparseMatrix** channels) {
+    uint8_t* p = (uint8_t*)plane;
+    channels[0] = sparse_matrix_from_dense_format(p, ROWS, COLS, 30, SPARSE_FORMAT_COO);
+    channels[1] = sparse_matrix_from_dense_format(p, ROWS, COLS, 30, SPARSE_FORMAT_CSR);
+    channels[2] = sparse_matrix_from_dense_format(p, ROWS, COLS, 90, SPARSE_FORMAT_RLE);
+    channels[3] = sparse_matrix_from_dense_format(p, ROWS, COLS, 0, SPARSE_FORMAT_BITMAP);
+    channels[4] = sparse_matrix_from_dense_format(p, ROWS, COLS, 30, SPARSE_FORMAT_DENSE);
+    channels[5] = sparse_matrix_from_dense_predicted(p, ROWS, COLS, 4, SPARSE_FORMAT_CSR, SPARSE_PREDICT_PAETH);
+    channels[6] = sparse_matrix_from_dense_quantized(p, ROWS, COLS, 30, SPARSE_FORMAT_RLE);
+    channels[7] = sparse_matrix_from_dense_format(p, ROWS, COLS, 255, SPARSE_FORMAT_CSR); // Empty
+    
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        if (!channels[ch]) return 0;
+    }
+    return 1;
+}
+
+static void free_channels(SparseMatrix** channels, int count) {
+    for (int ch = 0; channels && ch < count; ch++) {
+        sparse_matrix_free(channels[ch]);
+    }
+}
+
+// Same shape, layout, predictor and decoded pixels
+static int same_channel(SparseMatrix* a, SparseMatrix* b) {
+    uint8_t da[ROWS * COLS], db[ROWS * COLS];
+    if (a->rows != b->rows || a->cols != b->cols || a->format != b->format || a->predictor != b->predictor ||
+        a->threshold != b->threshold || a->size != b->size) {
+        return 0;
+    }
+    sparse_matrix_to_dense(a, da);
+    sparse_matrix_to_dense(b, db);
+    return memcmp(da, db, sizeof(da)) == 0;
+}
+
+static int same_channels(SparseMatrix** a, SparseMatrix** b, int count) {
+    for (int ch = 0; ch < count; ch++) {
+        if (!same_channel(a[ch], b[ch])) return 0;
+    }
+    return 1;
+}
+
+// Keep only the first `length` bytes of the file
+static int truncate_file(const char* path, long length) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return 0;
+    uint8_t buffer[1 << 16];
+    size_t n = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    if (n < (size_t)length) return 0;
+    
+    file = fopen(path, "wb");
+    if (!file) return 0;
+    int ok = fwrite(buffer, 1, (size_t)length, file) == (size_t)length;
+    return fclose(file) == 0 && ok;
+}
+
+// Overwrite n bytes of the file at offset
+static int patch_file(const char* path, long offset, const void* bytes, size_t n) {
+    FILE* file = fopen(path, "r+b");
+    if (!file) return 0;
+    int ok = fseek(file, offset, SEEK_SET) == 0 && fwrite(bytes, 1, n, file) == n;
+    return fclose(file) == 0 && ok;
+}
+
+// Mapped files hand out every layout in place, quantized values included,
+// and a bitmap channel without pixels can still be walked
+static int mapped_round_trip(SparseMatrix** channels) {
+    SparseMatrix* all[CHANNELS + 1];
+    memcpy(all, channels, sizeof(SparseMatrix*) * CHANNELS);
+    all[CHANNELS] = sparse_matrix_create_format(0, COLS, 0, SPARSE_FORMAT_BITMAP);
+    if (!all[CHANNELS] || !sparse_io_save_mapped(PATH, all, CHANNELS + 1)) {
+        sparse_matrix_free(all[CHANNELS]);
+        return 0;
+    }
+    
+    SparseMapping* mapping = sparse_io_map(PATH);
+    int ok = mapping && mapping->channel_count == CHANNELS + 1 && sparse_io_verify(mapping) &&
+             same_channels(channels, mapping->channels, CHANNELS) && mapping->channels[6]->quantized;
+    if (ok) {
+        SparseIterator it;
+        int row, col;
+        uint8_t value;
+        sparse_iterator_init(&it, mapping->channels[CHANNELS]);
+        ok = !sparse_iterator_next(&it, &row, &col, &value);
+    }
+    sparse_io_unmap(mapping);
+    
+    // Loading copies the same channels out
+    int count = 0;
+    SparseMatrix** loaded = ok ? sparse_io_load(PATH, &count) : NULL;
+    ok = loaded && count == CHANNELS + 1 && same_channels(channels, loaded, CHANNELS);
+    free_channels(loaded, loaded ? count : 0);
+    free(loaded);
+    
+    sparse_matrix_free(all[CHANNELS]);
+    return ok;
+}
+
+// Damage the CSR channel of a mapped file. A bad column opens, since only
+// offsets are checked then, but fails verification and loading; a bad row
+// pointer is refused at open.
+static int mapped_damage(SparseMatrix** channels, int row_pointer) {
+    if (!sparse_io_save_mapped(PATH, channels, CHANNELS)) return 0;
+    
+    SparseMapping* mapping = sparse_io_map(PATH);
+    if (!mapping) return 0;
+    SparseMatrix* csr = mapping->channels[1];
+    const uint8_t* base = (const uint8_t*)mapping->base;
+    long offset = row_pointer ? (long)((const uint8_t*)&csr->row_ptr[ROWS / 2] - base)
+                              : (long)((const uint8_t*)&csr->col_idx[csr->size / 2] - base);
+    sparse_io_unmap(mapping);
+    
+    int64_t bad_row_ptr = -5;
+    int bad_col = COLS + 100;
+    int ok = row_pointer ? patch_file(PATH, offset, &bad_row_ptr, sizeof(bad_row_ptr))
+                         : patch_file(PATH, offset, &bad_col, sizeof(bad_col));
+    if (!ok) return 0;
+    
+    mapping = sparse_io_map(PATH);
+    ok = row_pointer ? mapping == NULL : mapping != NULL && !sparse_io_verify(mapping);
+    sparse_io_unmap(mapping);
+    
+    int count;
+    SparseMatrix** loaded = sparse_io_load(PATH, &count);
+    if (loaded) {
+        free_channels(loaded, count);
+        free(loaded);
+        ok = 0;
+    }
+    return ok;
+}
+
+int main(void) {
+    int failed = 0;
+    
+    uint8_t plane[ROWS * COLS];
+    SparseMatrix* channels[CHANNELS] = { 0 };
+    fill_plane(plane);
+    if (!make_channels(plane, channels)) {
+        printf("FAIL: building channels\n");
+        return 1;
+    }
+    
+    // Streamed files keep every layout and predictor; quantized values come
+    // back as full bytes
+    int count = 0;
+    SparseMatrix** loaded = NULL;
+    if (sparse_io_save(PATH, channels, CHANNELS)) {
+        loaded = sparse_io_load(PATH, &count);
+    }
+    if (!loaded || count != CHANNELS || !same_channels(channels, loaded, CHANNELS - 2) ||
+        !same_channel(channels[CHANNELS - 1], loaded[CHANNELS - 1])) {
+        printf("FAIL: streamed round trip\n");
+        failed = 1;
+    } else {
+        uint8_t want[ROWS * COLS], got[ROWS * COLS];
+        sparse_matrix_to_dense(channels[6], want);
+        sparse_matrix_to_dense(loaded[6], got);
+        if (loaded[6]->quantized || memcmp(want, got, sizeof(want)) != 0) {
+            printf("FAIL: streamed quantized channel\n");
+            failed = 1;
+        }
+    }
+    free_channels(loaded, loaded ? count : 0);
+    free(loaded);
+    
+    // A cut-off file is refused rather than read past its end
+    long sizes[] = { 3, 20, 100 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        sparse_io_save(PATH, channels, CHANNELS);
+        if (!truncate_file(PATH, sizes[i]) || sparse_io_load(PATH, &count)) {
+            printf("FAIL: truncated file at %ld bytes\n", sizes[i]);
+            failed = 1;
+        }
+    }
+    
+    if (!mapped_round_trip(channels)) {
+        printf("FAIL: mapped round trip\n");
+        failed = 1;
+    }
+    if (!mapped_damage(channels, 0)) {
+        printf("FAIL: mapped file with a bad column\n");
+        failed = 1;
+    }
+    if (!mapped_damage(channels, 1)) {
+        printf("FAIL: mapped file with a bad row pointer\n");
+        failed = 1;
+    }
+    
+    free_channels(channels, CHANNELS);
+    remove(PATH);
+    if (!failed) printf("sparse io: all tests passed\n");
+    return failed;
+}
@@ -0,0 +1,176 @@
+// Add/get checks for every sparse layout: `make test`
+#include "sparse_matrix.h"
+#include <stdio.h>
+#include <string.h>
+
+#define ROWS 37
+#define COLS 53
+#define THRESHOLD 40
+
+static const SparseFormat formats[] = {
+    SPARSE_FORMAT_COO, SPARSE_FORMAT_CSR, SPARSE_FORMAT_RLE, SPARSE_FORMAT_BITMAP, SPARSE_FORMAT_DENSE
+};
+static const char* format_names[] = { "COO", "CSR", "RLE", "BITMAP", "DENSE" };
+#define FORMAT_COUNT (int)(sizeof(formats) / sizeof(formats[0]))
+
+// Runs of survivors, isolated pixels and empty rows; odd sizes so rows
+// straddle bitmap words
+static void fill_plane(uint8_t* plane) {
+    uint32_t seed = 12345;
+    for (int i = 0; i < ROWS * COLS; i++) {
+        seed = seed * 1103515245 + 12345;
+        int row = i / COLS;
+        int col = i % COLS;
+        if (row % 7 == 3) {
+            plane[i] = 0;
+        } else if (col >= row && col < row + 9) {
+            plane[i] = (uint8_t)(100 + col);
+        } else {
+            plane[i] = (uint8_t)((seed >> 16) % 4 == 0 ? seed >> 24 : 0);
+        }
+    }
+}
+
+// The matrix reads back as the plane with values at or below the
+// threshold zeroed, through every accessor
+static int matches(SparseMatrix* m, const uint8_t* plane) {
+    uint8_t dense[ROWS * COLS];
+    sparse_matrix_to_dense(m, dense);
+    
+    int64_t nnz = 0;
+    for (int i = 0; i < ROWS * COLS; i++) {
+        uint8_t want = plane[i] > THRESHOLD ? plane[i] : 0;
+        nnz += want != 0;
+        if (dense[i] != want || sparse_matrix_get(m, i / COLS, i % COLS) != want) return 0;
+    }
+    
+    // The iterator visits the same values in row-major order
+    SparseIterator it;
+    int row, col, prev = -1;
+    uint8_t value;
+    int64_t seen = 0;
+    sparse_iterator_init(&it, m);
+    while (sparse_iterator_next(&it, &row, &col, &value)) {
+        int idx = row * COLS + col;
+        if (idx <= prev || value != dense[idx]) return 0;
+        prev = idx;
+        seen++;
+    }
+    
+    return m->size == nnz && seen == nnz;
+}
+
+// Every layout built from a plane, by appends and by conversion from every
+// other layout reads back the same
+static int round_trips(SparseFormat format, const uint8_t* plane) {
+    SparseMatrix* m = sparse_matrix_from_dense_format((uint8_t*)plane, ROWS, COLS, THRESHOLD, format);
+    SparseMatrix* added = sparse_matrix_create_format(ROWS, COLS, THRESHOLD, format);
+    if (!m || !added) return 0;
+    
+    int ok = m->format == format && matches(m, plane);
+    for (int i = 0; i < ROWS * COLS; i++) {
+        ok = ok && sparse_matrix_add(added, i / COLS, i % COLS, plane[i]);
+    }
+    ok = ok && matches(added, plane);
+    
+    for (int f = 0; ok && f < FORMAT_COUNT; f++) {
+        SparseMatrix* other = sparse_matrix_convert(m, formats[f]);
+        ok = other && other->format == formats[f] && matches(other, plane);
+        sparse_matrix_free(other);
+    }
+    
+    sparse_matrix_free(m);
+    sparse_matrix_free(added);
+    return ok;
+}
+
+// Region reads match a crop of the whole decoded plane, with zeros
+// wherever the rectangle leaves the matrix
+static int regions(SparseMatrix* m) {
+    static const int rects[][4] = {
+        { 0, 0, COLS, ROWS }, { 5, 3, 20, 11 }, { 0, 9, COLS, 1 }, { 50, 30, 10, 10 },
+        { -4, -2, 9, 6 }, { -10, -10, COLS + 20, ROWS + 20 }, { COLS, 0, 4, 4 }, { 17, 36, 1, 1 }
+    };
+    uint8_t plane[ROWS * COLS];
+    uint8_t out[(ROWS + 20) * (COLS + 20)];
+    sparse_matrix_to_dense(m, plane);
+    
+    for (size_t r = 0; r < sizeof(rects) / sizeof(rects[0]); r++) {
+        int x = rects[r][0], y = rects[r][1], width = rects[r][2], height = rects[r][3];
+        memset(out, 0xAA, sizeof(out));
+        sparse_matrix_to_dense_region(m, x, y, width, height, out);
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++) {
+                int row = y + i, col = x + j;
+                int inside = row >= 0 && row < ROWS && col >= 0 && col < COLS;
+                if (out[i * width + j] != (inside ? plane[row * COLS + col] : 0)) return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Appends that go backwards or repeat a position are refused and leave the
+// stored values, and everything read from them, untouched
+static int ordering(SparseFormat format) {
+    SparseMatrix* m = sparse_matrix_create_format(4, 4, 0, format);
+    if (!m) return 0;
+    
+    int ok = sparse_matrix_add(m, 2, 2, 50) == 1 &&
+             sparse_matrix_add(m, 0, 1, 60) == 0 &&   // Earlier row
+             sparse_matrix_add(m, 2, 1, 60) == 0 &&   // Earlier column
+             sparse_matrix_add(m, 2, 2, 70) == 0 &&   // Duplicate
+             sparse_matrix_add(m, 4, 0, 10) == 0 &&   // Out of range
+             sparse_matrix_add(m, 3, 0, 9) == 1 &&
+             m->size == 2;
+    
+    uint8_t dense[16];
+    sparse_matrix_to_dense(m, dense);
+    for (int i = 0; i < 16; i++) {
+        uint8_t want = i == 10 ? 50 : i == 12 ? 9 : 0;
+        if (dense[i] != want || sparse_matrix_get(m, i / 4, i % 4) != want) ok = 0;
+    }
+    
+    sparse_matrix_free(m);
+    return ok;
+}
+
+int main(void) {
+    int failed = 0;
+    
+    uint8_t plane[ROWS * COLS];
+    fill_plane(plane);
+    for (int f = 0; f < FORMAT_COUNT; f++) {
+        if (!round_trips(formats[f], plane)) {
+            printf("FAIL: %s round trip\n", format_names[f]);
+            failed = 1;
+        }
+    }
+    
+    for (int f = 0; f < FORMAT_COUNT; f++) {
+        SparseMatrix* m = sparse_matrix_from_dense_format(plane, ROWS, COLS, THRESHOLD, formats[f]);
+        SparseMatrix* predicted = sparse_matrix_from_dense_predicted(plane, ROWS, COLS, THRESHOLD, formats[f],
+                                                                     SPARSE_PREDICT_PAETH);
+        if (!m || !regions(m)) {
+            printf("FAIL: %s region\n", format_names[f]);
+            failed = 1;
+        }
+        if (!predicted || !regions(predicted)) {
+            printf("FAIL: %s predicted region\n", format_names[f]);
+            failed = 1;
+        }
+        sparse_matrix_free(m);
+        sparse_matrix_free(predicted);
+    }
+    
+    // DENSE overwrites in place rather than appending
+    for (int i = 0; i < FORMAT_COUNT - 1; i++) {
+        if (!ordering(formats[i])) {
+            printf("FAIL: %s add ordering\n", format_names[i]);
+            failed = 1;
+        }
+    }
+    
+    if (!failed) printf("sparse matrix: all tests passed\n");
+    return failed;
+}
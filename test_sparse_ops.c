@@ -0,0 +1,154 @@
+// Sparse-domain operation checks: `make test`
+#include "sparse_ops.h"
+#include <stdio.h>
+#include <string.h>
+
+#define ROWS 23
+#define COLS 41
+#define THRESHOLD 25
+
+static const SparseFormat formats[] = {
+    SPARSE_FORMAT_COO, SPARSE_FORMAT_CSR, SPARSE_FORMAT_RLE, SPARSE_FORMAT_BITMAP, SPARSE_FORMAT_DENSE
+};
+static const char* format_names[] = { "COO", "CSR", "RLE", "BITMAP", "DENSE" };
+#define FORMAT_COUNT (int)(sizeof(formats) / sizeof(formats[0]))
+
+// Two overlapping planes: a horizontal band with noise, and a diagonal
+static void fill_planes(uint8_t* a, uint8_t* b) {
+    uint32_t seed = 4242;
+    for (int i = 0; i < ROWS * COLS; i++) {
+        seed = seed * 1103515245 + 12345;
+        int row = i / COLS;
+        int col = i % COLS;
+        a[i] = row > 5 && row < 15 ? (uint8_t)(30 + col * 5) : (uint8_t)((seed >> 16) % 5 == 0 ? seed >> 24 : 0);
+        b[i] = col - row > -3 && col - row < 6 ? (uint8_t)(200 - row) : 0;
+    }
+}
+
+// Zero everything at or below the threshold, as a matrix stores it
+static void threshold_plane(uint8_t* plane) {
+    for (int i = 0; i < ROWS * COLS; i++) {
+        if (plane[i] <= THRESHOLD) plane[i] = 0;
+    }
+}
+
+// The matrix kept its layout and holds exactly the expected plane
+static int holds(SparseMatrix* m, SparseFormat format, const uint8_t* expected) {
+    if (!m || m->format != format) return 0;
+    
+    uint8_t dense[ROWS * COLS];
+    int64_t nnz = 0;
+    sparse_matrix_to_dense(m, dense);
+    for (int i = 0; i < ROWS * COLS; i++) {
+        nnz += expected[i] != 0;
+    }
+    return m->size == nnz && memcmp(dense, expected, sizeof(dense)) == 0;
+}
+
+// Value maps act on the stored pixels only and drop what falls to the
+// threshold
+static int value_maps(SparseFormat format, const uint8_t* plane) {
+    uint8_t luts[3][256];
+    sparse_ops_lut_brightness(luts[0], 30);
+    sparse_ops_lut_brightness(luts[1], -60);
+    sparse_ops_lut_contrast(luts[2], 1.5f);
+    
+    int ok = 1;
+    uint8_t expected[ROWS * COLS];
+    for (int l = 0; ok && l < 3; l++) {
+        SparseMatrix* m = sparse_matrix_from_dense_format((uint8_t*)plane, ROWS, COLS, THRESHOLD, format);
+        for (int i = 0; i < ROWS * COLS; i++) {
+            expected[i] = plane[i] > THRESHOLD ? luts[l][plane[i]] : 0;
+        }
+        threshold_plane(expected);
+        ok = m && sparse_ops_apply_lut(m, luts[l]) && holds(m, format, expected);
+        sparse_matrix_free(m);
+    }
+    
+    // Factors of 2 and 0.5 round exactly
+    float factors[] = { 2.0f, 0.5f };
+    for (int f = 0; ok && f < 2; f++) {
+        SparseMatrix* m = sparse_matrix_from_dense_format((uint8_t*)plane, ROWS, COLS, THRESHOLD, format);
+        for (int i = 0; i < ROWS * COLS; i++) {
+            int v = plane[i] > THRESHOLD ? plane[i] : 0;
+            v = factors[f] > 1.0f ? v * 2 : (v + 1) / 2;
+            expected[i] = (uint8_t)(v > 255 ? 255 : v);
+        }
+        threshold_plane(expected);
+        ok = m && sparse_ops_scale(m, factors[f]) && holds(m, format, expected);
+        sparse_matrix_free(m);
+    }
+    
+    return ok;
+}
+
+// Combinations match the same arithmetic on the thresholded planes, with
+// b in a different layout from a
+static int combinations(SparseFormat format, const uint8_t* pa, const uint8_t* pb) {
+    SparseMatrix* a = sparse_matrix_from_dense_format((uint8_t*)pa, ROWS, COLS, THRESHOLD, format);
+    SparseMatrix* b = sparse_matrix_from_dense_format((uint8_t*)pb, ROWS, COLS, THRESHOLD,
+                                                      format == SPARSE_FORMAT_RLE ? SPARSE_FORMAT_BITMAP
+                                                                                  : SPARSE_FORMAT_RLE);
+    if (!a || !b) {
+        sparse_matrix_free(a);
+        sparse_matrix_free(b);
+        return 0;
+    }
+    
+    int ok = 1;
+    uint8_t expected[ROWS * COLS];
+    for (int op = 0; ok && op < 3; op++) {
+        for (int i = 0; i < ROWS * COLS; i++) {
+            int va = pa[i] > THRESHOLD ? pa[i] : 0;
+            int vb = pb[i] > THRESHOLD ? pb[i] : 0;
+            int v = op == 0 ? va + vb : op == 1 ? va - vb : (vb ? va : 0);
+            expected[i] = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+        }
+        threshold_plane(expected);
+        
+        SparseMatrix* m = op == 0 ? sparse_ops_add(a, b)
+                        : op == 1 ? sparse_ops_subtract(a, b)
+                                  : sparse_ops_mask(a, b);
+        ok = holds(m, format, expected);
+        sparse_matrix_free(m);
+    }
+    
+    sparse_matrix_free(a);
+    sparse_matrix_free(b);
+    return ok;
+}
+
+int main(void) {
+    int failed = 0;
+    
+    uint8_t a[ROWS * COLS], b[ROWS * COLS];
+    fill_planes(a, b);
+    for (int f = 0; f < FORMAT_COUNT; f++) {
+        if (!value_maps(formats[f], a)) {
+            printf("FAIL: %s value maps\n", format_names[f]);
+            failed = 1;
+        }
+        if (!combinations(formats[f], a, b)) {
+            printf("FAIL: %s combinations\n", format_names[f]);
+            failed = 1;
+        }
+    }
+    
+    // Predicted matrices store residuals, which value maps cannot touch
+    SparseMatrix* predicted = sparse_matrix_from_dense_predicted(a, ROWS, COLS, THRESHOLD, SPARSE_FORMAT_CSR,
+                                                                 SPARSE_PREDICT_LEFT);
+    SparseMatrix* plain = sparse_matrix_from_dense_format(a, ROWS, COLS, THRESHOLD, SPARSE_FORMAT_CSR);
+    SparseMatrix* sum = sparse_ops_add(plain, predicted);
+    uint8_t lut[256];
+    sparse_ops_lut_brightness(lut, 10);
+    if (!predicted || !plain || sparse_ops_apply_lut(predicted, lut) || sum) {
+        printf("FAIL: predicted matrices accepted\n");
+        failed = 1;
+    }
+    sparse_matrix_free(predicted);
+    sparse_matrix_free(plain);
+    sparse_matrix_free(sum);
+    
+    if (!failed) printf("sparse ops: all tests passed\n");
+    return failed;
+}
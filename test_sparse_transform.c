@@ -0,0 +1,118 @@
+// Sparse-domain geometric transform checks: `make test`
+#include "sparse_transform.h"
+#include <stdio.h>
+#include <string.h>
+
+#define ROWS 19
+#define COLS 34
+#define THRESHOLD 15
+
+static const SparseFormat formats[] = {
+    SPARSE_FORMAT_COO, SPARSE_FORMAT_CSR, SPARSE_FORMAT_RLE, SPARSE_FORMAT_BITMAP, SPARSE_FORMAT_DENSE
+};
+static const char* format_names[] = { "COO", "CSR", "RLE", "BITMAP", "DENSE" };
+#define FORMAT_COUNT (int)(sizeof(formats) / sizeof(formats[0]))
+
+enum { TRANSPOSE, ROTATE_90, ROTATE_180, ROTATE_270, FLIP_H, FLIP_V, CROP, TRANSFORM_COUNT };
+static const char* transform_names[] = {
+    "transpose", "rotate 90", "rotate 180", "rotate 270", "flip horizontal", "flip vertical", "crop"
+};
+
+// Crop rectangle, partly outside the matrix on the right
+#define CROP_X 20
+#define CROP_Y 4
+#define CROP_W 20
+#define CROP_H 9
+
+// Values change from each pixel to the next and most are above the
+// threshold, so a misplaced value shows
+static void fill_plane(uint8_t* plane) {
+    for (int i = 0; i < ROWS * COLS; i++) {
+        int row = i / COLS;
+        int col = i % COLS;
+        plane[i] = (row + col) % 4 == 0 ? 0 : (uint8_t)(16 + (row * COLS + col) % 240);
+    }
+}
+
+// Source pixel that lands at (row, col) of the result
+static int source_index(int t, int row, int col) {
+    switch (t) {
+    case TRANSPOSE:  return col * COLS + row;
+    case ROTATE_90:  return (ROWS - 1 - col) * COLS + row;
+    case ROTATE_180: return (ROWS - 1 - row) * COLS + (COLS - 1 - col);
+    case ROTATE_270: return col * COLS + (COLS - 1 - row);
+    case FLIP_H:     return row * COLS + (COLS - 1 - col);
+    case FLIP_V:     return (ROWS - 1 - row) * COLS + col;
+    default:         return (CROP_Y + row) * COLS + CROP_X + col;
+    }
+}
+
+static SparseMatrix* apply(int t, SparseMatrix* m) {
+    switch (t) {
+    case TRANSPOSE:  return sparse_transform_transpose(m);
+    case ROTATE_90:  return sparse_transform_rotate(m, 90);
+    case ROTATE_180: return sparse_transform_rotate(m, 180);
+    case ROTATE_270: return sparse_transform_rotate(m, -90);
+    case FLIP_H:     return sparse_transform_flip_horizontal(m);
+    case FLIP_V:     return sparse_transform_flip_vertical(m);
+    default:         return sparse_transform_crop(m, CROP_X, CROP_Y, CROP_W, CROP_H);
+    }
+}
+
+static int check(int t, SparseFormat format, const uint8_t* plane) {
+    SparseMatrix* m = sparse_matrix_from_dense_format((uint8_t*)plane, ROWS, COLS, THRESHOLD, format);
+    SparseMatrix* out = m ? apply(t, m) : NULL;
+    if (!out) {
+        sparse_matrix_free(m);
+        return 0;
+    }
+    
+    int sideways = t == TRANSPOSE || t == ROTATE_90 || t == ROTATE_270;
+    int rows = t == CROP ? CROP_H : sideways ? COLS : ROWS;
+    int cols = t == CROP ? COLS - CROP_X : sideways ? ROWS : COLS;
+    int ok = out->format == format && out->rows == rows && out->cols == cols;
+    
+    uint8_t dense[ROWS * COLS];
+    if (ok) sparse_matrix_to_dense(out, dense);
+    int64_t nnz = 0;
+    for (int i = 0; ok && i < rows * cols; i++) {
+        uint8_t v = plane[source_index(t, i / cols, i % cols)];
+        uint8_t want = v > THRESHOLD ? v : 0;
+        nnz += want != 0;
+        ok = dense[i] == want;
+    }
+    ok = ok && out->size == nnz;
+    
+    sparse_matrix_free(m);
+    sparse_matrix_free(out);
+    return ok;
+}
+
+int main(void) {
+    int failed = 0;
+    
+    uint8_t plane[ROWS * COLS];
+    fill_plane(plane);
+    for (int f = 0; f < FORMAT_COUNT; f++) {
+        for (int t = 0; t < TRANSFORM_COUNT; t++) {
+            if (!check(t, formats[f], plane)) {
+                printf("FAIL: %s %s\n", format_names[f], transform_names[t]);
+                failed = 1;
+            }
+        }
+    }
+    
+    // Predicted residuals depend on their neighbours and cannot be moved
+    SparseMatrix* predicted = sparse_matrix_from_dense_predicted(plane, ROWS, COLS, THRESHOLD, SPARSE_FORMAT_CSR,
+                                                                 SPARSE_PREDICT_UP);
+    SparseMatrix* moved = predicted ? sparse_transform_transpose(predicted) : NULL;
+    if (!predicted || moved) {
+        printf("FAIL: predicted matrix transformed\n");
+        failed = 1;
+    }
+    sparse_matrix_free(predicted);
+    sparse_matrix_free(moved);
+    
+    if (!failed) printf("sparse transform: all tests passed\n");
+    return failed;
+}
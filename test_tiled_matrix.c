@@ -0,0 +1,92 @@
+// Tiled block-sparse checks: `make test`
+#include "tiled_matrix.h"
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ROWS 45
+#define COLS 70
+#define THRESHOLD 20
+
+// A bright block in one corner and sparse dots elsewhere, so most tiles of
+// a small tile size are empty
+static void fill_plane(uint8_t* plane) {
+    for (int i = 0; i < ROWS * COLS; i++) {
+        int row = i / COLS;
+        int col = i % COLS;
+        if (row < 12 && col < 15) {
+            plane[i] = (uint8_t)(50 + row + col);
+        } else {
+            plane[i] = (row * 7 + col * 3) % 31 == 0 ? 200 : 10;
+        }
+    }
+}
+
+static int round_trip(const uint8_t* plane, int tile_size) {
+    TiledMatrix* tiled = tiled_matrix_from_dense((uint8_t*)plane, ROWS, COLS, THRESHOLD, tile_size);
+    if (!tiled) return 0;
+    
+    uint8_t dense[ROWS * COLS];
+    tiled_matrix_to_dense(tiled, dense);
+    int ok = 1;
+    for (int i = 0; i < ROWS * COLS; i++) {
+        uint8_t want = plane[i] > THRESHOLD ? plane[i] : 0;
+        if (dense[i] != want || tiled_matrix_get(tiled, i / COLS, i % COLS) != want) ok = 0;
+    }
+    
+    // A rectangle across tile edges and past the matrix corner
+    uint8_t region[30 * 40];
+    tiled_matrix_to_dense_region(tiled, 50, 25, 40, 30, region);
+    for (int i = 0; i < 30; i++) {
+        for (int j = 0; j < 40; j++) {
+            int row = 25 + i, col = 50 + j;
+            uint8_t want = row < ROWS && col < COLS ? dense[row * COLS + col] : 0;
+            if (region[i * 40 + j] != want) ok = 0;
+        }
+    }
+    
+    // Tiles with nothing above the threshold are left out
+    int ts = tiled->tile_size;
+    for (int ty = 0; ty < tiled->tiles_y; ty++) {
+        for (int tx = 0; tx < tiled->tiles_x; tx++) {
+            int any = 0;
+            for (int row = ty * ts; row < ROWS && row < (ty + 1) * ts; row++) {
+                for (int col = tx * ts; col < COLS && col < (tx + 1) * ts; col++) {
+                    any |= dense[row * COLS + col] != 0;
+                }
+            }
+            if (any != (tiled_matrix_get_tile(tiled, tx, ty) != NULL)) ok = 0;
+        }
+    }
+    
+    tiled_matrix_free(tiled);
+    return ok;
+}
+
+int main(void) {
+    int failed = 0;
+    
+    uint8_t plane[ROWS * COLS];
+    fill_plane(plane);
+    
+    // Tile sizes that divide the plane, leave ragged edges, or exceed it
+    int sizes[] = { 1, 5, 7, 16, TILED_MATRIX_DEFAULT_TILE, 1000, INT_MAX };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (!round_trip(plane, sizes[i])) {
+            printf("FAIL: round trip with %d pixel tiles\n", sizes[i]);
+            failed = 1;
+        }
+    }
+    
+    // A directory too large for int indices is refused before the plane
+    // is read
+    TiledMatrix* huge = tiled_matrix_from_dense(plane, 70000, 70000, THRESHOLD, 1);
+    if (huge) {
+        printf("FAIL: oversized tile directory accepted\n");
+        tiled_matrix_free(huge);
+        failed = 1;
+    }
+    
+    if (!failed) printf("tiled matrix: all tests passed\n");
+    return failed;
+}
@@ -0,0 +1,177 @@
+#include "tiled_matrix.h"
+#include "sparse_kernels.h"
+#include <limits.h>
+#include <string.h>
+
+// Width and height of tile (tx, ty); tiles on the right and bottom edges
+// are clipped to the matrix
+static int tile_width(TiledMatrix* tiled, int tx) {
+    int64_t w = tiled->cols - (int64_t)tx * tiled->tile_size;
+    return w < tiled->tile_size ? (int)w : tiled->tile_size;
+}
+
+static int tile_height(TiledMatrix* tiled, int ty) {
+    int64_t h = tiled->rows - (int64_t)ty * tiled->tile_size;
+    return h < tiled->tile_size ? (int)h : tiled->tile_size;
+}
+
+// Bytes of a scratch buffer that fits the largest tile, or 0 if that does
+// not fit in a size_t
+static size_t tile_scratch_bytes(TiledMatrix* tiled) {
+    uint64_t w = tiled->tile_size < tiled->cols ? tiled->tile_size : tiled->cols;
+    uint64_t h = tiled->tile_size < tiled->rows ? tiled->tile_size : tiled->rows;
+    return w * h <= SIZE_MAX ? (size_t)(w * h) : 0;
+}
+
+TiledMatrix* tiled_matrix_from_dense(uint8_t* dense, int rows, int cols, uint8_t threshold, int tile_size) {
+    if (!dense || rows <= 0 || cols <= 0) return NULL;
+    if (tile_size <= 0) tile_size = TILED_MATRIX_DEFAULT_TILE;
+    
+    // The directory is indexed with ints, so its size must fit in one
+    int64_t tiles_x = ((int64_t)cols + tile_size - 1) / tile_size;
+    int64_t tiles_y = ((int64_t)rows + tile_size - 1) / tile_size;
+    if (tiles_x * tiles_y > INT_MAX) return NULL;
+    
+    TiledMatrix* tiled = (TiledMatrix*)malloc(sizeof(TiledMatrix));
+    if (!tiled) return NULL;
+    
+    tiled->rows = rows;
+    tiled->cols = cols;
+    tiled->threshold = threshold;
+    tiled->tile_size = tile_size;
+    tiled->tiles_x = (int)tiles_x;
+    tiled->tiles_y = (int)tiles_y;
+    tiled->tiles = (SparseMatrix**)calloc((size_t)(tiles_x * tiles_y), sizeof(SparseMatrix*));
+    
+    // One tile is copied out at a time so it stays in L1/L2 while it is
+    // counted and converted
+    size_t scratch_bytes = tile_scratch_bytes(tiled);
+    uint8_t* scratch = scratch_bytes ? (uint8_t*)malloc(scratch_bytes) : NULL;
+    
+    if (!tiled->tiles || !scratch) {
+        free(scratch);
+        tiled_matrix_free(tiled);
+        return NULL;
+    }
+    
+    for (int ty = 0; ty < tiled->tiles_y; ty++) {
+        for (int tx = 0; tx < tiled->tiles_x; tx++) {
+            int w = tile_width(tiled, tx);
+            int h = tile_height(tiled, ty);
+            const uint8_t* src = dense + (int64_t)ty * tile_size * cols + (int64_t)tx * tile_size;
+            
+            int64_t nnz = 0;
+            for (int i = 0; i < h; i++) {
+                memcpy(scratch + (int64_t)i * w, src + (int64_t)i * cols, w);
+                nnz += sparse_count_above(scratch + (int64_t)i * w, w, threshold);
+            }
+            
+            // Empty tiles cost nothing beyond their directory entry
+            if (nnz == 0) continue;
+            
+            SparseMatrix* tile = sparse_matrix_from_dense_format(scratch, h, w, threshold, SPARSE_FORMAT_AUTO);
+            if (!tile) {
+                free(scratch);
+                tiled_matrix_free(tiled);
+                return NULL;
+            }
+            tiled->tiles[ty * tiled->tiles_x + tx] = tile;
+        }
+    }
+    
+    free(scratch);
+    return tiled;
+}
+
+void tiled_matrix_free(TiledMatrix* tiled) {
+    if (tiled) {
+        if (tiled->tiles) {
+            for (int t = 0; t < tiled->tiles_x * tiled->tiles_y; t++) {
+                sparse_matrix_free(tiled->tiles[t]);
+            }
+            free(tiled->tiles);
+        }
+        free(tiled);
+    }
+}
+
+// Tile at directory position (tile_x, tile_y), or NULL if it is empty
+SparseMatrix* tiled_matrix_get_tile(TiledMatrix* tiled, int tile_x, int tile_y) {
+    if (tile_x < 0 || tile_x >= tiled->tiles_x || tile_y < 0 || tile_y >= tiled->tiles_y) return NULL;
+    return tiled->tiles[tile_y * tiled->tiles_x + tile_x];
+}
+
+void tiled_matrix_to_dense(TiledMatrix* tiled, uint8_t* dense) {
+    tiled_matrix_to_dense_region(tiled, 0, 0, tiled->cols, tiled->rows, dense);
+}
+
+// Reconstruct only the rectangle (x, y, width, height) into a width * height
+// buffer. Tiles outside the rectangle are never decoded, and the others only
+// where they overlap it.
+void tiled_matrix_to_dense_region(TiledMatrix* tiled, int x, int y, int width, int height, uint8_t* dense) {
+    if (width <= 0 || height <= 0) return;
+    memset(dense, 0, (size_t)width * height * sizeof(uint8_t));
+    
+    // Clip the rectangle to the matrix
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = (int64_t)x + width < tiled->cols ? x + width : tiled->cols;
+    int y1 = (int64_t)y + height < tiled->rows ? y + height : tiled->rows;
+    if (x0 >= x1 || y0 >= y1) return;
+    
+    int ts = tiled->tile_size;
+    size_t scratch_bytes = tile_scratch_bytes(tiled);
+    uint8_t* scratch = scratch_bytes ? (uint8_t*)malloc(scratch_bytes) : NULL;
+    if (!scratch) return;
+    
+    for (int ty = y0 / ts; ty <= (y1 - 1) / ts; ty++) {
+        for (int tx = x0 / ts; tx <= (x1 - 1) / ts; tx++) {
+            SparseMatrix* tile = tiled->tiles[ty * tiled->tiles_x + tx];
+            if (!tile) continue;
+            
+            // Intersection of this tile with the requested rectangle
+            int cx0 = tx * ts > x0 ? tx * ts : x0;
+            int cy0 = ty * ts > y0 ? ty * ts : y0;
+            int cx1 = (int64_t)(tx + 1) * ts < x1 ? (tx + 1) * ts : x1;
+            int cy1 = (int64_t)(ty + 1) * ts < y1 ? (ty + 1) * ts : y1;
+            
+            // Decode just that part of the tile
+            sparse_matrix_to_dense_region(tile, cx0 - tx * ts, cy0 - ty * ts, cx1 - cx0, cy1 - cy0, scratch);
+            for (int r = cy0; r < cy1; r++) {
+                memcpy(dense + (int64_t)(r - y) * width + (cx0 - x),
+                       scratch + (int64_t)(r - cy0) * (cx1 - cx0),
+                       cx1 - cx0);
+            }
+        }
+    }
+    
+    free(scratch);
+}
+
+uint8_t tiled_matrix_get(TiledMatrix* tiled, int row, int col) {
+    if (row < 0 || row >= tiled->rows || col < 0 || col >= tiled->cols) return 0;
+    
+    int ts = tiled->tile_size;
+    SparseMatrix* tile = tiled->tiles[(row / ts) * tiled->tiles_x + col / ts];
+    return tile ? sparse_matrix_get(tile, row % ts, col % ts) : 0;
+}
+
+size_t tiled_matrix_get_size_bytes(TiledMatrix* tiled) {
+    size_t bytes = sizeof(TiledMatrix) + (size_t)tiled->tiles_x * tiled->tiles_y * sizeof(SparseMatrix*);
+    
+    for (int t = 0; t < tiled->tiles_x * tiled->tiles_y; t++) {
+        if (tiled->tiles[t]) {
+            bytes += sparse_matrix_get_size_bytes(tiled->tiles[t]);
+        }
+    }
+    
+    return bytes;
+}
+
+float tiled_matrix_compression_ratio(TiledMatrix* tiled) {
+    size_t dense_size = dense_matrix_get_size_bytes(tiled->rows, tiled->cols);
+    size_t tiled_size = tiled_matrix_get_size_bytes(tiled);
+    
+    if (tiled_size == 0) return 0.0f;
+    return (float)dense_size / (float)tiled_size;
+}
@@ -0,0 +1,33 @@
+#ifndef TILED_MATRIX_H
+#define TILED_MATRIX_H
+
+#include "sparse_matrix.h"
+#include <stdint.h>
+
+#define TILED_MATRIX_DEFAULT_TILE 64
+
+// Block-sparse matrix: the plane is cut into square tiles, each encoded on
+// its own. Tiles with nothing above the threshold are NULL in the
+// directory; the rest pick their own layout (dense or one of the sparse
+// formats) through SPARSE_FORMAT_AUTO.
+typedef struct {
+    SparseMatrix** tiles; // tiles_y * tiles_x directory in row-major order, NULL = empty
+    int tiles_x;          // Tiles per row of the directory
+    int tiles_y;          // Tiles per column of the directory
+    int tile_size;        // Edge length of a full tile (edge tiles may be smaller)
+    int rows;             // Original matrix rows
+    int cols;             // Original matrix cols
+    uint8_t threshold;    // Threshold below which values are considered zero
+} TiledMatrix;
+
+// Function declarations
+TiledMatrix* tiled_matrix_from_dense(uint8_t* dense, int rows, int cols, uint8_t threshold, int tile_size);
+void tiled_matrix_free(TiledMatrix* tiled);
+SparseMatrix* tiled_matrix_get_tile(TiledMatrix* tiled, int tile_x, int tile_y);
+void tiled_matrix_to_dense(TiledMatrix* tiled, uint8_t* dense);
+void tiled_matrix_to_dense_region(TiledMatrix* tiled, int x, int y, int width, int height, uint8_t* dense);
+uint8_t tiled_matrix_get(TiledMatrix* tiled, int row, int col);
+size_t tiled_matrix_get_size_bytes(TiledMatrix* tiled);
+float tiled_matrix_compression_ratio(TiledMatrix* tiled);
+
+#endif // TILED_MATRIX_H